@@ -0,0 +1,242 @@
+// Benchmark dello scambio dei bordi da solo, senza funzione di transizione.
+//
+// Riproduce lo scambio di parasites.cpp: griglia 2D di processi (MPI_Dims_create), blocchi che
+// differiscono al più di una riga/colonna, cornice profonda haloDepth celle, datatype vettoriali
+// per righe, colonne e angoli e richieste persistenti verso gli 8 vicini (MPI_Startall + MPI_Waitall).
+// Per ogni dimensione della griglia e profondità della cornice si misura il tempo di uno scambio
+// (il massimo tra i processi, la media su --iters scambi) e il processo 0 scrive i risultati in JSON.
+//
+// Compile and run (dalla cartella principale):
+//  > mpicxx -O2 bench/bench_halo.cpp -o bench_halo
+//  > mpirun -np 4 ./bench_halo --json halo.json
+//  > mpirun -np 8 ./bench_halo --sizes 1000,4000 --halo-depths 1,2,4 --iters 500
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <vector>
+#include "mpi.h"
+
+#define MPI_CELL MPI_UINT8_T
+#define MAX_CASES 16
+
+int sizes[MAX_CASES] = {500, 2000, 8000}, sizeCount = 3;
+int depths[MAX_CASES] = {1, 2, 4}, depthCount = 3;
+int iters = 200;
+const char *jsonPath = NULL;
+int rank, nprocs;
+
+int parseArgs(int argc, char** argv);
+int parseList(const char *text, int *values);
+void blockRange(int n, int parts, int index, int *offset, int *size);
+double exchange(int size, int haloDepth, long *bytes);
+
+
+int main(int argc, char** argv){
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if(parseArgs(argc, argv) == -1){
+        MPI_Finalize();
+        return -1;
+    }
+
+    FILE *json = NULL;
+    if(rank == 0){
+        json = jsonPath ? fopen(jsonPath, "w") : stdout;
+        if(json == NULL){
+            printf("Error: cannot create %s!\n", jsonPath);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        fprintf(json, "{\"benchmark\":\"halo\",\"ranks\":%d,\"iters\":%d,\"results\":[", nprocs, iters);
+    }
+
+    const char *separator = "\n";
+    for(int i = 0; i < sizeCount; ++i){
+        for(int d = 0; d < depthCount; ++d){
+            long bytes;
+            double seconds = exchange(sizes[i], depths[d], &bytes);
+            if(seconds < 0)
+                continue;
+
+            if(rank == 0){
+                fprintf(json, "%s{\"rows\":%d,\"cols\":%d,\"halo_depth\":%d,\"seconds_per_exchange\":%.9f,"
+                              "\"seconds_per_gen\":%.9f,\"bytes_per_exchange\":%ld,\"bytes_per_s\":%.6e}",
+                        separator, sizes[i], sizes[i], depths[d], seconds, seconds / depths[d], bytes,
+                        seconds > 0 ? bytes / seconds : 0.0);
+                separator = ",\n";
+                if(jsonPath)
+                    printf("%5dx%-5d depth=%d %.3f us/exchange %.3f us/gen %ld bytes\n", sizes[i], sizes[i], depths[d],
+                           seconds * 1e6, seconds / depths[d] * 1e6, bytes);
+            }
+        }
+    }
+
+    if(rank == 0){
+        fprintf(json, "\n]}\n");
+        if(jsonPath)
+            fclose(json);
+    }
+    MPI_Finalize();
+    return 0;
+}
+
+// Lettura delle opzioni da riga di comando; restituisce -1 se il programma deve terminare
+int parseArgs(int argc, char** argv){
+    static struct option longOptions[] = {
+        {"sizes",       required_argument, 0, 'z'},
+        {"halo-depths", required_argument, 0, 'k'},
+        {"iters",       required_argument, 0, 'n'},
+        {"json",        required_argument, 0, 'j'},
+        {"help",        no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    opterr = (rank == 0);
+    while((opt = getopt_long(argc, argv, "z:k:n:j:h", longOptions, NULL)) != -1){
+        switch(opt){
+            case 'z': sizeCount = parseList(optarg, sizes); break;
+            case 'k': depthCount = parseList(optarg, depths); break;
+            case 'n': iters = atoi(optarg); break;
+            case 'j': jsonPath = optarg; break;
+
+            default:
+                if(rank == 0)
+                    printf("Usage: %s [--sizes N,N,...] [--halo-depths K,K,...] [--iters N] [--json FILE]\n", argv[0]);
+                return -1;
+        }
+    }
+
+    bool valid = sizeCount > 0 && depthCount > 0 && iters > 0;
+    for(int i = 0; i < sizeCount; ++i)
+        valid = valid && sizes[i] > 0;
+    for(int d = 0; d < depthCount; ++d)
+        valid = valid && depths[d] > 0;
+    if(!valid){
+        if(rank == 0)
+            printf("Error: invalid sizes, halo depths or iterations!\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Lista di interi separati da virgole (al più MAX_CASES); restituisce quanti ne ha letti, 0 se non è valida
+int parseList(const char *text, int *values){
+    int n = 0;
+    char *end;
+    while(n < MAX_CASES){
+        values[n++] = (int)strtol(text, &end, 10);
+        if(end == text)
+            return 0;
+        if(*end != ',')
+            return *end == '\0' ? n : 0;
+        text = end + 1;
+    }
+    return 0;
+}
+
+// Divisione di n righe (o colonne) in parts blocchi, come in parasites.cpp
+void blockRange(int n, int parts, int index, int *offset, int *size){
+    *size = n / parts + (index < n % parts);
+    *offset = index * (n / parts) + (index < n % parts ? index : n % parts);
+}
+
+// Tempo medio di uno scambio dei bordi di una griglia size x size con cornice profonda haloDepth
+// (il massimo tra i processi); bytes sono i byte inviati da tutti i processi in uno scambio.
+// Restituisce -1 se qualche blocco è più sottile della cornice
+double exchange(int size, int haloDepth, long *bytes){
+    int dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+    MPI_Comm comm;
+    MPI_Dims_create(nprocs, 2, dims);
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &comm);
+    MPI_Cart_coords(comm, rank, 2, coords);
+
+    int rowOffset, colOffset, localRows, localCols;
+    blockRange(size, dims[0], coords[0], &rowOffset, &localRows);
+    blockRange(size, dims[1], coords[1], &colOffset, &localCols);
+
+    int thinnest = localRows < localCols ? localRows : localCols;
+    MPI_Allreduce(MPI_IN_PLACE, &thinnest, 1, MPI_INT, MPI_MIN, comm);
+    if(thinnest < haloDepth){
+        if(rank == 0)
+            fprintf(stderr, "Warning: skipping %dx%d with halo depth %d (blocks are too thin)\n", size, size, haloDepth);
+        MPI_Comm_free(&comm);
+        return -1;
+    }
+
+    int stride = localCols + 2*haloDepth;
+    std::vector<uint8_t> block((size_t)(localRows + 2*haloDepth)*stride, 1);
+    auto at = [&](int r, int c){ return (r+haloDepth-1)*stride + c+haloDepth-1; };
+
+    MPI_Datatype rowBorderType, colBorderType, cornerType, haloType[8];
+    MPI_Type_vector(haloDepth, localCols, stride, MPI_CELL, &rowBorderType);
+    MPI_Type_vector(localRows, haloDepth, stride, MPI_CELL, &colBorderType);
+    MPI_Type_vector(haloDepth, haloDepth, stride, MPI_CELL, &cornerType);
+    MPI_Type_commit(&rowBorderType);
+    MPI_Type_commit(&colBorderType);
+    MPI_Type_commit(&cornerType);
+
+    // Direzioni nello stesso ordine di parasites.cpp: N, S, W, E, NW, NE, SW, SE
+    const int dr[8] = {-1, 1, 0, 0, -1, -1, 1, 1};
+    const int dc[8] = {0, 0, -1, 1, -1, 1, -1, 1};
+    const int opposite[8] = {1, 0, 3, 2, 7, 6, 5, 4};
+    MPI_Request requests[16];
+    long sent = 0;
+
+    for(int d = 0; d < 8; ++d){
+        int c[2] = {coords[0] + dr[d], coords[1] + dc[d]}, neighbor;
+        if(c[0] < 0 || c[0] >= dims[0] || c[1] < 0 || c[1] >= dims[1])
+            neighbor = MPI_PROC_NULL;
+        else
+            MPI_Cart_rank(comm, c, &neighbor);
+
+        int sendRow = dr[d] < 0 ? 1 : localRows-haloDepth+1, sendCol = dc[d] < 0 ? 1 : localCols-haloDepth+1;
+        int recvRow = dr[d] < 0 ? 1-haloDepth : localRows+1, recvCol = dc[d] < 0 ? 1-haloDepth : localCols+1;
+        if(dr[d] == 0){
+            sendRow = recvRow = 1;
+            haloType[d] = colBorderType;
+        }
+        else if(dc[d] == 0){
+            sendCol = recvCol = 1;
+            haloType[d] = rowBorderType;
+        }
+        else haloType[d] = cornerType;
+
+        MPI_Recv_init(&block[at(recvRow, recvCol)], 1, haloType[d], neighbor, opposite[d], comm, &requests[d]);
+        MPI_Send_init(&block[at(sendRow, sendCol)], 1, haloType[d], neighbor, d, comm, &requests[8+d]);
+        if(neighbor != MPI_PROC_NULL){
+            int typeBytes;
+            MPI_Type_size(haloType[d], &typeBytes);
+            sent += typeBytes;
+        }
+    }
+
+    // Qualche scambio di riscaldamento, poi iters scambi cronometrati partendo insieme
+    for(int i = 0; i < 10; ++i){
+        MPI_Startall(16, requests);
+        MPI_Waitall(16, requests, MPI_STATUSES_IGNORE);
+    }
+    MPI_Barrier(comm);
+    double start = MPI_Wtime();
+    for(int i = 0; i < iters; ++i){
+        MPI_Startall(16, requests);
+        MPI_Waitall(16, requests, MPI_STATUSES_IGNORE);
+    }
+    double seconds = (MPI_Wtime() - start) / iters;
+
+    MPI_Allreduce(MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&sent, bytes, 1, MPI_LONG, MPI_SUM, comm);
+
+    for(int i = 0; i < 16; ++i)
+        MPI_Request_free(&requests[i]);
+    MPI_Type_free(&rowBorderType);
+    MPI_Type_free(&colBorderType);
+    MPI_Type_free(&cornerType);
+    MPI_Comm_free(&comm);
+    return seconds;
+}
@@ -0,0 +1,224 @@
+/*
+---------- BENCHMARK DEL KERNEL ----------
+Misura la funzione di transizione da sola (kernel.h), senza MPI né grafica: per ogni kernel
+(scalare e, se la CPU lo supporta, AVX2), dimensione della griglia, densità di parassiti e fase
+(generazione dell'erba o dei parassiti) la griglia viene calcolata più volte e si tiene il tempo
+migliore. I risultati vengono scritti in JSON, per confrontare versioni diverse del kernel.
+
+COMANDO PER COMPILARE ED ESEGUIRE IL CODICE (dalla cartella principale):
+> g++ -O2 bench/bench_kernel.cpp -o bench_kernel
+> ./bench_kernel --json kernel.json
+> ./bench_kernel --sizes 512,2048 --densities 0,0.05 --reps 10 --stats
+
+Con --stats il kernel conta anche le transizioni di stato (stats.h), per misurarne il costo.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <vector>
+#include "../kernel.h"
+#include "../rng.h"
+
+#define MAX_CASES 16
+
+int sizes[MAX_CASES] = {256, 1024, 4096}, sizeCount = 3;
+double densities[MAX_CASES] = {0, 0.001, 0.01, 0.1, 0.3};
+int densityCount = 5;
+int reps = 5;
+bool countTransitions = false;
+const char *jsonPath = NULL;
+uint32_t seed = 42;
+
+inline int parseArgs(int argc, char *argv[]);
+inline int parseList(const char *text, double *values);
+inline double wtime();
+inline void fillGrid(std::vector<cell_t> &grid, int rows, int cols, double density);
+inline double sweep(RowKernel kernel, const std::vector<cell_t> &in, std::vector<cell_t> &out,
+                    int rows, int cols, int gen, RowScratch &s);
+
+
+int main(int argc, char *argv[])
+{
+    if(parseArgs(argc, argv) == -1)
+        return -1;
+
+    FILE *json = jsonPath ? fopen(jsonPath, "w") : stdout;
+    if(json == NULL) {
+        printf("Errore: impossibile creare %s...\n", jsonPath);
+        return -1;
+    }
+
+    struct { const char *name; RowKernel kernel; } kernels[2];
+    int kernelCount = 0;
+    kernels[kernelCount].kernel = selectKernel(true, &kernels[kernelCount].name);
+    kernelCount++;
+    const char *name;
+    RowKernel best = selectKernel(false, &name);
+    if(best != kernels[0].kernel) {
+        kernels[kernelCount].name = name;
+        kernels[kernelCount].kernel = best;
+        kernelCount++;
+    }
+
+    fprintf(json, "{\"benchmark\":\"kernel\",\"reps\":%d,\"stats\":%d,\"results\":[", reps, countTransitions ? 1 : 0);
+    const char *separator = "\n";
+
+    for(int i = 0; i < sizeCount; ++i) {
+        int rows = sizes[i], cols = sizes[i];
+        // Griglia con una cornice di EMPTY, come nella versione seriale
+        std::vector<cell_t> in, out((size_t)(rows + 2) * (cols + 2), EMPTY);
+        std::vector<uint8_t> mem(scratchSize(cols));
+        uint64_t counts[TRANSITION_COUNT];
+        RowScratch s = makeScratch(mem.data(), cols);
+        s.counts = countTransitions ? counts : NULL;
+
+        for(int d = 0; d < densityCount; ++d) {
+            fillGrid(in, rows, cols, densities[d]);
+
+            for(int k = 0; k < kernelCount; ++k) {
+                // Generazione pari: erba; dispari (dopo LATE_DEATH_GEN, con tutte le regole): parassiti
+                for(int phase = 0; phase < 2; ++phase) {
+                    int gen = 2 * LATE_DEATH_GEN + phase;
+                    double seconds = sweep(kernels[k].kernel, in, out, rows, cols, gen, s);
+                    double cells = (double)rows * cols;
+
+                    fprintf(json, "%s{\"kernel\":\"%s\",\"phase\":\"%s\",\"rows\":%d,\"cols\":%d,\"parasite_density\":%g,"
+                                  "\"seconds\":%.9f,\"ns_per_cell\":%.4f,\"cells_per_s\":%.6e}",
+                            separator, kernels[k].name, phase == 0 ? "grass" : "parasites", rows, cols, densities[d],
+                            seconds, seconds / cells * 1e9, cells / seconds);
+                    separator = ",\n";
+                    if(jsonPath)
+                        printf("%-6s %-9s %5dx%-5d density=%-6g %.3f ns/cell\n", kernels[k].name,
+                               phase == 0 ? "grass" : "parasites", rows, cols, densities[d], seconds / cells * 1e9);
+                }
+            }
+        }
+    }
+    fprintf(json, "\n]}\n");
+
+    if(jsonPath)
+        fclose(json);
+    return 0;
+}
+
+// Lettura delle opzioni da riga di comando; restituisce -1 se il programma deve terminare
+inline int parseArgs(int argc, char *argv[])
+{
+    static struct option longOptions[] = {
+        {"sizes",     required_argument, 0, 'z'},
+        {"densities", required_argument, 0, 'd'},
+        {"reps",      required_argument, 0, 'n'},
+        {"seed",      required_argument, 0, 'S'},
+        {"stats",     no_argument,       0, 'a'},
+        {"json",      required_argument, 0, 'j'},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    double values[MAX_CASES];
+    int opt;
+    while((opt = getopt_long(argc, argv, "z:d:n:S:aj:h", longOptions, NULL)) != -1) {
+        switch(opt) {
+            case 'z':
+                sizeCount = parseList(optarg, values);
+                for(int i = 0; i < sizeCount; ++i)
+                    sizes[i] = (int)values[i];
+                break;
+            case 'd':
+                densityCount = parseList(optarg, densities);
+                break;
+            case 'n': reps = atoi(optarg); break;
+            case 'S': seed = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'a': countTransitions = true; break;
+            case 'j': jsonPath = optarg; break;
+
+            default:
+                printf("Uso: %s [--sizes N,N,...] [--densities D,D,...] [--reps N] [--seed N] [--stats] [--json FILE]\n", argv[0]);
+                return -1;
+        }
+    }
+
+    bool valid = sizeCount > 0 && densityCount > 0 && reps > 0;
+    for(int i = 0; i < sizeCount; ++i)
+        valid = valid && sizes[i] > 0;
+    for(int d = 0; d < densityCount; ++d)
+        valid = valid && densities[d] >= 0 && densities[d] <= 1;
+    if(!valid) {
+        printf("Errore: dimensioni, densità (tra 0 e 1) o ripetizioni non validi...\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Lista di numeri separati da virgole (al più MAX_CASES); restituisce quanti ne ha letti, 0 se non è valida
+inline int parseList(const char *text, double *values)
+{
+    int n = 0;
+    char *end;
+    while(n < MAX_CASES) {
+        values[n++] = strtod(text, &end);
+        if(end == text)
+            return 0;
+        if(*end != ',')
+            return *end == '\0' ? n : 0;
+        text = end + 1;
+    }
+    return 0;
+}
+
+inline double wtime()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Griglia casuale (riproducibile con --seed): PARASITE con probabilità density, le altre celle
+// in gran parte GROWN_GRASS come nella simulazione, con un po' di EMPTY ed erba in crescita
+inline void fillGrid(std::vector<cell_t> &grid, int rows, int cols, double density)
+{
+    grid.assign((size_t)(rows + 2) * (cols + 2), EMPTY);
+    uint32_t parasite = (uint32_t)(density * 4294967295.0);
+
+    for(int r = 0; r < rows; ++r) {
+        for(int c = 0; c < cols; ++c) {
+            uint32_t u = philox(seed, 0, r, c);
+            cell_t s;
+            if(density > 0 && u <= parasite)
+                s = PARASITE;
+            else {
+                uint32_t v = philox(seed, 1, r, c) % 10;
+                s = v < 7 ? GROWN_GRASS : v == 7 ? EMPTY : v == 8 ? SEEDED_GRASS : GROWING_GRASS;
+            }
+            grid[(size_t)(r + 1) * (cols + 2) + c + 1] = s;
+        }
+    }
+}
+
+// Tempo migliore su reps passate del kernel su tutta la griglia (sempre dalla stessa generazione)
+inline double sweep(RowKernel kernel, const std::vector<cell_t> &in, std::vector<cell_t> &out,
+                    int rows, int cols, int gen, RowScratch &s)
+{
+    size_t stride = cols + 2;
+    double best = 1e30;
+
+    for(int rep = 0; rep < reps; ++rep) {
+        if(s.counts)
+            memset(s.counts, 0, TRANSITION_COUNT * sizeof(uint64_t));
+
+        double start = wtime();
+        for(int r = 0; r < rows; ++r) {
+            RowContext ctx = {gen, r, 0, seed};
+            const cell_t *mid = &in[(r + 1) * stride + 1];
+            kernel(mid - stride, mid, mid + stride, &out[(r + 1) * stride + 1], cols, ctx, s);
+        }
+        double t = wtime() - start;
+        best = t < best ? t : best;
+    }
+    return best;
+}
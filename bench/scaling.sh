@@ -0,0 +1,98 @@
+#!/bin/bash
+# Scalabilità forte e debole di parasites.cpp con mpirun sui processi della macchina locale.
+#
+# Scalabilità forte: la stessa griglia (-n x -n celle) con un numero crescente di processi.
+# Scalabilità debole: ogni processo ha (circa) -w x -w celle, quindi la griglia cresce con i processi.
+# Ogni configurazione viene eseguita in modalità headless; dalla riga BENCH si prendono i tempi.
+# Speedup ed efficienza sono relativi alla prima configurazione della lista (-p):
+#   forte:  speedup = wall(p0) / wall(p), efficienza = speedup * p0 / p
+#   debole: efficienza = wall(p0) / wall(p)
+# Stampa una tabella e scrive i risultati in JSON (-o).
+#
+# Compilare prima la versione MPI (dalla cartella principale), poi:
+#  > mpicxx -O2 -pthread parasites.cpp -o parasites -lallegro
+#  > bench/scaling.sh -b ./parasites -p "1 2 4 8" -n 4000 -w 2000 -s 200 -o scaling.json
+# Le opzioni dopo -- vengono passate a parasites (ad esempio -- --threads 2 --fuse 2);
+# MPIRUN permette di cambiare il lanciatore (ad esempio MPIRUN="mpirun --oversubscribe").
+
+binary=./a.out
+procs="1 2 4"
+strongSize=2000
+weakSize=1000
+steps=200
+seed=42
+json=scaling.json
+mpirun=${MPIRUN:-mpirun}
+
+usage() {
+    echo "Usage: $0 [-b BINARY] [-p \"P P ...\"] [-n STRONG_SIZE] [-w WEAK_SIZE_PER_RANK] [-s STEPS] [-S SEED] [-o JSON] [-- PARASITES_ARGS]"
+    exit 1
+}
+
+while getopts "b:p:n:w:s:S:o:h" opt; do
+    case $opt in
+        b) binary=$OPTARG ;;
+        p) procs=$OPTARG ;;
+        n) strongSize=$OPTARG ;;
+        w) weakSize=$OPTARG ;;
+        s) steps=$OPTARG ;;
+        S) seed=$OPTARG ;;
+        o) json=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ "$1" = "--" ] && shift
+extra="$*"
+
+if [ ! -x "$binary" ]; then
+    echo "Error: $binary is not an executable (compile parasites.cpp and pass it with -b)"
+    exit 1
+fi
+
+# Valore della chiave $2 nella riga BENCH $1
+field() {
+    echo "$1" | tr ' ' '\n' | awk -F= -v key="$2" '$1 == key { print $2 }'
+}
+
+# Esegue una configurazione: $1 = modalità, $2 = processi, $3 = lato della griglia.
+# Stampa "mode procs size wall_s gens_per_s cell_updates_per_s imbalance"
+run() {
+    local bench
+    bench=$($mpirun -np "$2" "$binary" --headless --rows "$3" --cols "$3" --steps "$steps" --seed "$seed" $extra | grep '^BENCH')
+    if [ -z "$bench" ]; then
+        echo "Error: no BENCH line from $binary with $2 processes" >&2
+        exit 1
+    fi
+    echo "$1 $2 $3 $(field "$bench" wall_s) $(field "$bench" gens_per_s) $(field "$bench" cell_updates_per_s) $(field "$bench" imbalance)"
+}
+
+results=$(
+    for p in $procs; do
+        run strong "$p" "$strongSize" || exit 1
+    done
+    for p in $procs; do
+        # Lato della griglia tale che ogni processo abbia circa weakSize^2 celle
+        size=$(awk -v w="$weakSize" -v p="$p" 'BEGIN { printf "%d", w * sqrt(p) + 0.5 }')
+        run weak "$p" "$size" || exit 1
+    done
+) || exit 1
+
+# Speedup ed efficienza rispetto alla prima riga di ciascuna modalità; tabella su stdout e JSON in $json
+echo "$results" | awk -v json="$json" -v steps="$steps" -v seed="$seed" -v binary="$binary" -v extra="$extra" '
+{
+    mode = $1; p = $2
+    if(!(mode in baseWall)) { baseWall[mode] = $4; baseProcs[mode] = p }
+    speedup = $4 > 0 ? baseWall[mode] / $4 : 0
+    efficiency = mode == "strong" ? speedup * baseProcs[mode] / p : speedup
+    line[NR] = sprintf("{\"mode\":\"%s\",\"ranks\":%d,\"rows\":%d,\"cols\":%d,\"wall_s\":%s,\"gens_per_s\":%s,\"cell_updates_per_s\":%s,\"imbalance\":%s,\"speedup\":%.4f,\"efficiency\":%.4f}",
+                       mode, p, $3, $3, $4, $5, $6, $7 == "" ? "null" : $7, speedup, efficiency)
+    printf "%-6s ranks=%-4d grid=%6dx%-6d wall=%9.4fs gens/s=%10.2f speedup=%6.2f efficiency=%5.1f%% imbalance=%s\n",
+           mode, p, $3, $3, $4, $5, speedup, efficiency * 100, $7
+}
+END {
+    printf "{\"benchmark\":\"scaling\",\"binary\":\"%s\",\"args\":\"%s\",\"steps\":%d,\"seed\":%d,\"results\":[\n", binary, extra, steps, seed > json
+    for(i = 1; i <= NR; ++i)
+        printf "%s%s", line[i], i < NR ? ",\n" : "\n" > json
+    printf "]}\n" > json
+}'
@@ -0,0 +1,51 @@
+// Formato dei file di checkpoint: un header di CHECKPOINT_HEADER_SIZE byte seguito dalla griglia
+// globale, ROWS x COLS celle di un byte in ordine di riga (indipendente dal numero di processi
+// che l'ha scritta o che la rilegge). Gli interi dell'header sono little-endian.
+//
+// Lo stato del generatore casuale è tutto in seed e generazione: il generatore è basato su
+// contatore (rng.h), quindi ripartire dalla generazione salvata dà la stessa sequenza.
+
+#ifndef PARASITES_CHECKPOINT_H
+#define PARASITES_CHECKPOINT_H
+
+#include <stdint.h>
+#include <string.h>
+#include "kernel.h"
+
+#define CHECKPOINT_MAGIC "PARACKPT"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEADER_SIZE 64
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t cellBytes;      // sizeof(cell_t)
+    uint32_t rows, cols;
+    uint32_t gen;            // generazione contenuta nella griglia
+    uint32_t seed;
+    uint8_t reserved[CHECKPOINT_HEADER_SIZE - 32];
+};
+
+static_assert(sizeof(CheckpointHeader) == CHECKPOINT_HEADER_SIZE, "header di checkpoint di dimensione errata");
+
+inline CheckpointHeader makeCheckpointHeader(int rows, int cols, int gen, uint32_t seed)
+{
+    CheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CHECKPOINT_MAGIC, 8);
+    h.version = CHECKPOINT_VERSION;
+    h.cellBytes = sizeof(cell_t);
+    h.rows = rows;
+    h.cols = cols;
+    h.gen = gen;
+    h.seed = seed;
+    return h;
+}
+
+inline bool validCheckpointHeader(const CheckpointHeader &h)
+{
+    return memcmp(h.magic, CHECKPOINT_MAGIC, 8) == 0 && h.version == CHECKPOINT_VERSION &&
+           h.cellBytes == sizeof(cell_t) && h.rows > 0 && h.cols > 0;
+}
+
+#endif
@@ -0,0 +1,246 @@
+// Kernel "bit-sliced" per insiemi di simulazioni indipendenti (parasites_ensemble.cpp).
+//
+// Lo stato di una cella in 64 repliche della griglia è memorizzato in 3 parole da 64 bit (piani di
+// bit): il bit i della parola b è il bit b dello stato della cella nella replica i. Con la codifica
+// degli stati di kernel.h (EMPTY 000, PARASITE 001, SEEDED 010, GROWING 011, GROWN 100) si ha
+//   GROWN = b2, PARASITE = b0 & ~b1, SEEDED = b1 & ~b0, GROWING = b1 & b0, EMPTY = ~(b0 | b1 | b2)
+// e ogni operazione logica su una parola aggiorna la stessa cella in 64 simulazioni.
+//
+// I vicini GROWN_GRASS e PARASITE dell'intorno 3x3 vengono sommati con sommatori a bit (full adder
+// sulle parole), come somme separabili: somme verticali a 2 bit, poi somme orizzontali a 4 bit.
+// Le regole sono quelle di ParasiteRules (kernel.h), ma ogni replica ha le sue soglie: SeedMin e
+// Crowding sono piani di bit confrontati con le somme, le probabilità sono soglie per replica.
+// I numeri casuali vengono da philox con il seed della replica e le coordinate globali della cella,
+// calcolati solo per le repliche in cui la cella ha un evento: ogni replica evolve esattamente come
+// la versione seriale con lo stesso seed e le stesse soglie.
+
+#ifndef PARASITES_ENSEMBLE_H
+#define PARASITES_ENSEMBLE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "kernel.h"
+#include "rng.h"
+
+#define ENSEMBLE_LANES 64
+
+// Bit del contatore di popolazione di ogni replica (fino a 2^32 celle)
+#define COUNTER_BITS 32
+
+typedef uint64_t lanes_t;
+
+// Parametri di una replica: seed e soglie delle regole di ParasiteRules
+struct ReplicaParams {
+    uint32_t seed;
+    int seedMin, crowding, infectionOdds, lateDeathOdds;
+};
+
+// Fino a 64 repliche della stessa griglia rows x cols. Le celle hanno una cornice EMPTY e i loro
+// 3 piani sono consecutivi: la cella (r, c) (da 0) è in planes + ((r+1)*stride + c+1)*3
+struct ReplicaPack {
+    int count;                              // repliche usate (i bit oltre count restano EMPTY)
+    lanes_t used;                           // bit delle repliche usate
+    lanes_t *read, *write;
+    lanes_t seedMin[4], crowding[4];        // soglie a 4 bit, un piano per bit
+    uint32_t seed[ENSEMBLE_LANES];
+    uint32_t infection[ENSEMBLE_LANES], lateDeath[ENSEMBLE_LANES];    // soglie di oddsThreshold
+};
+
+// Buffer di lavoro di una riga: somme verticali a 2 bit di GROWN e PARASITE (colonne da -1 a cols)
+struct PackScratch {
+    lanes_t *grass0, *grass1, *parasites0, *parasites1;
+};
+
+inline size_t packPlanes(int rows, int cols) { return (size_t)(rows + 2) * (cols + 2) * 3; }
+inline size_t packScratchSize(int cols) { return 4 * (size_t)(cols + 2); }
+
+inline PackScratch makePackScratch(lanes_t *mem, int cols)
+{
+    PackScratch s;
+    s.grass0 = mem + 1;
+    s.grass1 = mem + (cols + 2) + 1;
+    s.parasites0 = mem + 2 * (cols + 2) + 1;
+    s.parasites1 = mem + 3 * (cols + 2) + 1;
+    return s;
+}
+
+// Scrive il valore v (4 bit) nei piani della replica lane
+inline void setLaneBits(lanes_t *planes, int lane, int v)
+{
+    for(int b = 0; b < 4; ++b)
+        planes[b] = (planes[b] & ~(1ull << lane)) | ((lanes_t)((v >> b) & 1) << lane);
+}
+
+inline void setReplica(ReplicaPack &p, int lane, const ReplicaParams &params)
+{
+    p.seed[lane] = params.seed;
+    p.infection[lane] = oddsThreshold(params.infectionOdds, RANDOM_RANGE);
+    p.lateDeath[lane] = oddsThreshold(params.lateDeathOdds, RANDOM_RANGE);
+    setLaneBits(p.seedMin, lane, params.seedMin);
+    setLaneBits(p.crowding, lane, params.crowding);
+}
+
+// Stato iniziale di tutte le repliche usate: GROWN_GRASS e un PARASITE al centro (come nella versione
+// seriale); la cornice e le repliche non usate sono EMPTY
+inline void initPack(ReplicaPack &p, int rows, int cols)
+{
+    int stride = cols + 2;
+    memset(p.read, 0, packPlanes(rows, cols) * sizeof(lanes_t));
+    memset(p.write, 0, packPlanes(rows, cols) * sizeof(lanes_t));
+    for(int r = 0; r < rows; ++r)
+        for(int c = 0; c < cols; ++c) {
+            lanes_t *cell = p.read + ((size_t)(r + 1) * stride + c + 1) * 3;
+            if(r == rows / 2 && c == cols / 2)
+                cell[0] = p.used;
+            else
+                cell[2] = p.used;
+        }
+}
+
+// Per ogni replica, count >= threshold (numeri a 4 bit, un piano per bit): confronto dal bit più alto
+inline lanes_t greaterEqual(const lanes_t *count, const lanes_t *threshold)
+{
+    lanes_t less = 0, equal = ~0ull;
+    for(int b = 3; b >= 0; --b) {
+        less |= equal & ~count[b] & threshold[b];
+        equal &= ~(count[b] ^ threshold[b]);
+    }
+    return ~less;
+}
+
+// Somma di tre numeri a 2 bit (colonne c-1, c, c+1) in un numero a 4 bit
+inline void horizontalSum(const lanes_t *v0, const lanes_t *v1, int c, lanes_t *sum)
+{
+    lanes_t a0 = v0[c-1] ^ v0[c], k = v0[c-1] & v0[c];
+    lanes_t t = v1[c-1] ^ v1[c];
+    lanes_t a1 = t ^ k, a2 = (v1[c-1] & v1[c]) | (k & t);
+
+    sum[0] = a0 ^ v0[c+1];
+    k = a0 & v0[c+1];
+    t = a1 ^ v1[c+1];
+    sum[1] = t ^ k;
+    k = (a1 & v1[c+1]) | (k & t);
+    sum[2] = a2 ^ k;
+    sum[3] = a2 & k;
+}
+
+// Riga r (da 0) della generazione gen di tutte le repliche del pacchetto; restituisce le repliche
+// che hanno ancora almeno un PARASITE nella riga calcolata
+inline lanes_t packRow(const ReplicaPack &p, int r, int cols, int gen, PackScratch &s)
+{
+    int stride = cols + 2;
+    const lanes_t *up = p.read + (size_t)r * stride * 3 + 3;
+    const lanes_t *mid = up + stride * 3, *down = mid + stride * 3;
+    lanes_t *out = p.write + ((size_t)(r + 1) * stride + 1) * 3;
+
+    // Somme verticali (full adder): bit 0 e bit 1 per colonna
+    for(int c = -1; c <= cols; ++c) {
+        const lanes_t *u = up + c * 3, *m = mid + c * 3, *d = down + c * 3;
+        lanes_t gu = u[2], gm = m[2], gd = d[2];
+        lanes_t pu = u[0] & ~u[1], pm = m[0] & ~m[1], pd = d[0] & ~d[1];
+        lanes_t x = gu ^ gm, y = pu ^ pm;
+        s.grass0[c] = x ^ gd;
+        s.grass1[c] = (gu & gm) | (x & gd);
+        s.parasites0[c] = y ^ pd;
+        s.parasites1[c] = (pu & pm) | (y & pd);
+    }
+
+    lanes_t alive = 0;
+    int phase = DefaultRules::phase(gen);
+
+    for(int c = 0; c < cols; ++c) {
+        const lanes_t *m = mid + c * 3;
+        lanes_t b0 = m[0], b1 = m[1], b2 = m[2];
+        lanes_t *o = out + c * 3;
+        lanes_t grass[4], parasites[4];
+
+        if(phase == GRASS_PHASE) {
+            horizontalSum(s.grass0, s.grass1, c, grass);
+            lanes_t growing = b1 & b0, seeded = b1 & ~b0;
+            lanes_t seeds = ~(b0 | b1 | b2) & greaterEqual(grass, p.seedMin);
+            o[0] = (b0 & ~b1) | seeded;
+            o[1] = (b1 & ~growing) | seeds;
+            o[2] = b2 | growing;
+            alive |= b0 & ~b1;
+            continue;
+        }
+
+        lanes_t parasite = b0 & ~b1;
+        lanes_t near = s.parasites0[c-1] | s.parasites0[c] | s.parasites0[c+1] |
+                       s.parasites1[c-1] | s.parasites1[c] | s.parasites1[c+1];
+        lanes_t attacked = b2 & near;
+
+        // Nessun parassita e nessuna preda attaccata in nessuna replica: la cella non cambia
+        if((parasite | attacked) == 0) {
+            o[0] = b0;
+            o[1] = b1;
+            o[2] = b2;
+            continue;
+        }
+
+        horizontalSum(s.grass0, s.grass1, c, grass);
+        horizontalSum(s.parasites0, s.parasites1, c, parasites);
+        lanes_t dies = parasite & (greaterEqual(parasites, p.crowding) | ~(grass[0] | grass[1] | grass[2] | grass[3]));
+
+        // Eventi casuali: infezione delle prede attaccate, morte tardiva dei parassiti sopravvissuti
+        lanes_t candidates = (attacked | (phase == LATE_PARASITE_PHASE ? parasite & ~dies : 0)) & p.used;
+        lanes_t events = 0;
+        while(candidates) {
+            int lane = __builtin_ctzll(candidates);
+            lanes_t bit = 1ull << lane;
+            uint32_t threshold = (attacked & bit) ? p.infection[lane] : p.lateDeath[lane];
+            if(philox(p.seed[lane], gen, r, c) < threshold)
+                events |= bit;
+            candidates &= candidates - 1;
+        }
+
+        lanes_t infects = attacked & events;
+        dies |= parasite & events;
+        o[0] = (b0 & ~dies) | infects;
+        o[1] = b1;
+        o[2] = b2 & ~infects;
+        alive |= (parasite & ~dies) | infects;
+    }
+    return alive;
+}
+
+// Aggiunge 1 ai contatori (piani di COUNTER_BITS bit) delle repliche in bits
+inline void countLanes(lanes_t *counter, lanes_t bits)
+{
+    for(int b = 0; bits != 0 && b < COUNTER_BITS; ++b) {
+        lanes_t carry = counter[b] & bits;
+        counter[b] ^= bits;
+        bits = carry;
+    }
+}
+
+// Popolazione di ogni stato in ogni replica: population[lane*STATE_COUNT + stato]
+inline void countPack(const ReplicaPack &p, int rows, int cols, uint64_t *population)
+{
+    lanes_t counters[STATE_COUNT][COUNTER_BITS];
+    memset(counters, 0, sizeof(counters));
+    int stride = cols + 2;
+
+    for(int r = 0; r < rows; ++r)
+        for(int c = 0; c < cols; ++c) {
+            const lanes_t *m = p.read + ((size_t)(r + 1) * stride + c + 1) * 3;
+            countLanes(counters[PARASITE], m[0] & ~m[1]);
+            countLanes(counters[SEEDED_GRASS], m[1] & ~m[0]);
+            countLanes(counters[GROWING_GRASS], m[1] & m[0]);
+            countLanes(counters[GROWN_GRASS], m[2]);
+        }
+
+    for(int lane = 0; lane < p.count; ++lane) {
+        uint64_t *row = population + (size_t)lane * STATE_COUNT;
+        uint64_t others = 0;
+        for(int s = PARASITE; s < STATE_COUNT; ++s) {
+            row[s] = 0;
+            for(int b = 0; b < COUNTER_BITS; ++b)
+                row[s] |= ((counters[s][b] >> lane) & 1) << b;
+            others += row[s];
+        }
+        row[EMPTY] = (uint64_t)rows * cols - others;
+    }
+}
+
+#endif
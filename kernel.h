@@ -0,0 +1,484 @@
+// Kernel di riga della funzione di transizione, condiviso dalla versione seriale e da quella MPI.
+//
+// Per ogni riga si calcolano i vicini GROWN_GRASS e PARASITE dell'intorno 3x3 (cella inclusa)
+// come somme separabili: prima le somme verticali (riga sopra + riga + riga sotto) per colonna,
+// poi le somme orizzontali di tre colonne consecutive. Il kernel legge anche le colonne -1 e cols
+// delle tre righe: il chiamante deve fornire una cornice (celle fantasma) intorno alla griglia,
+// EMPTY ai bordi (non conta né come GROWN_GRASS né come PARASITE) o ricevuta dai vicini. Le regole deterministiche vengono
+// applicate senza salti tramite confronti e blend; i numeri casuali delle regole stocastiche
+// vengono dal generatore basato su contatore di rng.h, quindi anche quelle sono senza salti
+// e il risultato non dipende dall'ordine di visita delle celle.
+//
+// Il kernel AVX2 elabora 32 celle alla volta; quello scalare è il fallback scelto a runtime
+// se la CPU non supporta AVX2 (o se richiesto esplicitamente).
+//
+// Le regole sono una classe passata come parametro di template (ParasiteRules, PARASITES_RULES),
+// da cui viene generata a tempo di compilazione una tabella indicizzata da fase, stato e vicini:
+// il kernel scalare (e le code di quello AVX2) fa una lettura della tabella per cella. Il kernel
+// AVX2 è specializzato per ParasiteRules, con le soglie come costanti dei confronti.
+//
+// Se il chiamante lo chiede (RowScratch::counts), il kernel conta anche le transizioni di stato
+// delle celle calcolate: nell'AVX2 con le stesse maschere che scelgono il nuovo stato (stats.h).
+
+#ifndef PARASITES_KERNEL_H
+#define PARASITES_KERNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <immintrin.h>
+#include "rng.h"
+
+// Stati in cui si può trovare una cella:
+// -EMPTY
+// -PARASITE è il predatore
+// -GRASS è la preda, ha 3 sotto-stati: SEEDED, GROWING, GROWN
+//
+// Transizioni di stato:
+// EMPTY -> SEEDED -> GROWING -> GROWN -> PARASITE -> EMPTY...
+
+enum states {EMPTY = 0, PARASITE, SEEDED_GRASS, GROWING_GRASS, GROWN_GRASS};
+#define STATE_COUNT 5
+
+// Gli stati sono solo 5, quindi ogni cella occupa un byte invece di un int
+typedef uint8_t cell_t;
+
+// Probabilità delle regole stocastiche: numero casuale tra 1 e RANDOM_RANGE, evento se <= ODDS
+#define RANDOM_RANGE 20
+#define INFECTION_ODDS 5
+#define LATE_DEATH_ODDS 5
+#define LATE_DEATH_GEN 50
+
+// Transizioni di stato contate dal kernel (le uniche possibili in una generazione)
+enum transitions {SEEDING = 0,     // EMPTY -> SEEDED_GRASS
+                  SPROUTING,       // SEEDED_GRASS -> GROWING_GRASS
+                  RIPENING,        // GROWING_GRASS -> GROWN_GRASS
+                  INFECTION,       // GROWN_GRASS -> PARASITE
+                  DEATH,           // PARASITE -> EMPTY
+                  TRANSITION_COUNT};
+
+// Buffer di lavoro di una riga: le somme verticali coprono anche le colonne -1 e cols
+struct RowScratch {
+    uint8_t *mem;            // memoria allocata dal chiamante (scratchSize(cols) byte)
+    uint8_t *grass;          // somme verticali di GROWN_GRASS (indici da -1 a cols)
+    uint8_t *parasites;      // somme verticali di PARASITE (indici da -1 a cols)
+    uint64_t *counts;        // TRANSITION_COUNT contatori da incrementare, NULL = non contare
+    int countFrom, countTo;  // si contano solo le celle da countFrom a countTo-1 della riga
+};
+
+// Generazione e posizione globale della riga: insieme al seed formano
+// il contatore del generatore casuale di ogni cella
+struct RowContext {
+    int gen;
+    int row;        // riga globale
+    int col0;       // colonna globale della prima cella della riga
+    uint32_t seed;
+    int rows, cols; // con bordi periodici, dimensioni della griglia globale (0 = bordi chiusi)
+};
+
+typedef void (*RowKernel)(const cell_t *up, const cell_t *mid, const cell_t *down,
+                          cell_t *out, int cols, const RowContext &ctx, RowScratch &s);
+
+inline size_t scratchSize(int cols) { return 2 * (size_t)(cols + 2); }
+
+// Applica il kernel a una riga che con bordi periodici può uscire dalla griglia globale (celle della
+// cornice ricalcolate localmente): riga e colonne del generatore casuale vengono riportate nella
+// griglia, così ogni cella riceve gli stessi numeri casuali della cella che rappresenta. La riga
+// viene divisa dove le colonne si richiudono, la finestra di conteggio di s segue ogni pezzo
+inline void periodicRow(RowKernel kernel, const cell_t *up, const cell_t *mid, const cell_t *down,
+                        cell_t *out, int cols, const RowContext &ctx, RowScratch &s)
+{
+    if(ctx.cols == 0) {
+        kernel(up, mid, down, out, cols, ctx, s);
+        return;
+    }
+
+    RowContext piece = ctx;
+    piece.row = (ctx.row % ctx.rows + ctx.rows) % ctx.rows;
+    int countFrom = s.countFrom, countTo = s.countTo;
+
+    for(int c = 0; c < cols; ) {
+        piece.col0 = ((ctx.col0 + c) % ctx.cols + ctx.cols) % ctx.cols;
+        int n = cols - c < ctx.cols - piece.col0 ? cols - c : ctx.cols - piece.col0;
+        s.countFrom = countFrom - c;
+        s.countTo = countTo - c;
+        kernel(up + c, mid + c, down + c, out + c, n, piece, s);
+        c += n;
+    }
+    s.countFrom = countFrom;
+    s.countTo = countTo;
+}
+
+// mem deve contenere scratchSize(cols) byte; cols è la larghezza massima delle righe elaborate
+inline RowScratch makeScratch(uint8_t *mem, int cols)
+{
+    RowScratch s;
+    s.mem = mem;
+    s.grass = mem + 1;
+    s.parasites = mem + (cols + 2) + 1;
+    s.counts = NULL;
+    s.countFrom = 0;
+    s.countTo = INT_MAX;
+    return s;
+}
+
+// ------------------------------------------------------
+// Regole del modello.
+// Un insieme di regole R è una classe con tre funzioni constexpr:
+// - R::phase(gen): fase della generazione (enum rulePhases);
+// - R::rule(phase, s, grass, parasites): stato successivo di una cella nello stato s con grass vicini
+//   GROWN_GRASS e parasites vicini PARASITE (nell'intorno 3x3, cella inclusa), come RuleOutcome;
+// - R::threshold(odds): soglia del numero casuale (oddsThreshold) dell'evento odds (da 1 a 3).
+// Da R viene generata a tempo di compilazione una tabella di un byte per ogni (fase, stato, vicini
+// GROWN_GRASS, vicini PARASITE): i kernel valutano una cella con una sola lettura della tabella,
+// senza catene di condizioni, e calcolano il numero casuale solo per le celle con un evento.
+
+enum rulePhases {GRASS_PHASE = 0,        // generazioni pari: si sviluppa solo l'erba
+                 PARASITE_PHASE,         // generazioni dispari: si sviluppano solo i parassiti
+                 LATE_PARASITE_PHASE,    // generazioni dispari dopo LATE_DEATH_GEN (morte casuale)
+                 RULE_PHASES};
+
+// Valori possibili delle somme dei vicini (da 0 a 9)
+#define NEIGHBORHOOD 10
+
+struct RuleOutcome {
+    uint8_t stay;    // stato successivo se l'evento non si verifica (o se la regola è deterministica)
+    uint8_t fire;    // stato successivo se l'evento si verifica
+    uint8_t odds;    // evento (R::threshold(odds)), 0 = regola deterministica
+};
+
+// Regole del modello con soglie e probabilità come parametri (i valori predefiniti sono quelli originali).
+//
+// Generazioni pari (GEN % 2 == 0): si sviluppa solo l'erba.
+// SEEDED_GRASS -> GROWING_GRASS -> GROWN_GRASS; GROWN_GRASS e PARASITE restano invariati.
+// Se una cella EMPTY ha 3 (SeedMin) o più vicini GROWN_GRASS, allora diventa GRASS
+// (SEEDED, perchè appena seminato); altrimenti, rimane EMPTY
+//
+// Generazioni dispari (GEN % 2 != 0): si sviluppano solo i parassiti.
+// Se una cella GROWN_GRASS (preda) ha almeno un vicino PARASITE (predatore)
+// e se il numero casuale è compreso tra 1 e 5, allora diventa un PARASITE;
+// altrimenti, rimane GROWN_GRASS.
+// Se una cella PARASITE ha 5 (Crowding) o più vicini PARASITE (sovrappopolazione)
+// oppure non ha alcun vicino GROWN_GRASS
+// oppure abbiamo superato la 50-esima iterazione (GEN > 50)
+// e il numero casuale è compreso tra 1 e 5,
+// allora muore, cioè diventa EMPTY; altrimenti, rimane PARASITE.
+// Le altre celle restano invariate
+template<int SeedMin = 3, int Crowding = 5, int InfectionOdds = INFECTION_ODDS,
+         int LateDeathOdds = LATE_DEATH_ODDS, int LateDeathGen = LATE_DEATH_GEN>
+struct ParasiteRules {
+    enum {INFECTION_EVENT = 1, LATE_DEATH_EVENT};
+
+    static constexpr int phase(int gen)
+    {
+        return gen % 2 == 0 ? GRASS_PHASE : gen > LateDeathGen ? LATE_PARASITE_PHASE : PARASITE_PHASE;
+    }
+
+    static constexpr RuleOutcome rule(int phase, int s, int grass, int parasites)
+    {
+        if(phase == GRASS_PHASE) {
+            if(s == EMPTY && grass >= SeedMin)
+                return RuleOutcome{SEEDED_GRASS, SEEDED_GRASS, 0};
+            if(s == SEEDED_GRASS || s == GROWING_GRASS)
+                return RuleOutcome{(uint8_t)(s + 1), (uint8_t)(s + 1), 0};
+        }
+        else if(s == GROWN_GRASS && parasites > 0)
+            return RuleOutcome{GROWN_GRASS, PARASITE, INFECTION_EVENT};
+        else if(s == PARASITE) {
+            if(parasites >= Crowding || grass == 0)
+                return RuleOutcome{EMPTY, EMPTY, 0};
+            if(phase == LATE_PARASITE_PHASE)
+                return RuleOutcome{PARASITE, EMPTY, LATE_DEATH_EVENT};
+        }
+        return RuleOutcome{(uint8_t)s, (uint8_t)s, 0};
+    }
+
+    static constexpr uint32_t threshold(int odds)
+    {
+        return odds == INFECTION_EVENT ? oddsThreshold(InfectionOdds, RANDOM_RANGE)
+             : odds == LATE_DEATH_EVENT ? oddsThreshold(LateDeathOdds, RANDOM_RANGE) : 0;
+    }
+};
+
+typedef ParasiteRules<> DefaultRules;
+
+// Regole usate dai due motori: si cambiano compilando ad esempio con -DPARASITES_RULES='ParasiteRules<3,6>',
+// oppure scrivendo una propria classe di regole (con l'interfaccia di ParasiteRules) in un header:
+//  > g++ -O2 -DPARASITES_RULES_HEADER='"myrules.h"' -DPARASITES_RULES=MyRules parasites_serial.cpp -lallegro
+#ifdef PARASITES_RULES_HEADER
+#include PARASITES_RULES_HEADER
+#endif
+#ifndef PARASITES_RULES
+#define PARASITES_RULES DefaultRules
+#endif
+
+// Tabella delle regole R: in ogni byte lo stato se l'evento non si verifica (bit 0-2), quello se si
+// verifica (bit 3-5) e l'evento (bit 6-7), con la sua soglia in threshold
+template<class R>
+struct RuleTable {
+    uint8_t entry[RULE_PHASES][STATE_COUNT][NEIGHBORHOOD][NEIGHBORHOOD];
+    uint32_t threshold[4];
+
+    constexpr RuleTable() : entry(), threshold()
+    {
+        for(int odds = 1; odds < 4; ++odds)
+            threshold[odds] = R::threshold(odds);
+        for(int phase = 0; phase < RULE_PHASES; ++phase)
+            for(int s = 0; s < STATE_COUNT; ++s)
+                for(int g = 0; g < NEIGHBORHOOD; ++g)
+                    for(int p = 0; p < NEIGHBORHOOD; ++p) {
+                        RuleOutcome r = R::rule(phase, s, g, p);
+                        entry[phase][s][g][p] = (uint8_t)(r.stay | r.fire << 3 | r.odds << 6);
+                    }
+    }
+};
+
+template<class R>
+inline const RuleTable<R> &ruleTable()
+{
+    static constexpr RuleTable<R> table;
+    return table;
+}
+
+// Le regole possono cambiare soglie, probabilità e condizioni, ma non il ciclo degli stati
+// (EMPTY -> SEEDED -> GROWING -> GROWN -> PARASITE -> EMPTY), perché il conteggio delle transizioni
+// conosce solo quelle di enum transitions. I tile inattivi di parasites.cpp contano inoltre sul fatto
+// che una cella senza parassiti nell'intorno non abbia eventi casuali e non dipenda da LATE_DEATH_GEN
+template<class R>
+constexpr bool validRules()
+{
+    for(int phase = 0; phase < RULE_PHASES; ++phase)
+        for(int s = 0; s < STATE_COUNT; ++s)
+            for(int g = 0; g < NEIGHBORHOOD; ++g)
+                for(int p = 0; p < NEIGHBORHOOD; ++p) {
+                    RuleOutcome r = R::rule(phase, s, g, p), early = R::rule(PARASITE_PHASE, s, g, p);
+                    int next = s == EMPTY ? SEEDED_GRASS : s == GROWN_GRASS ? PARASITE : s == PARASITE ? EMPTY : s + 1;
+                    if((r.stay != s && r.stay != next) || (r.fire != s && r.fire != next) || r.odds > 3)
+                        return false;
+                    if(s != PARASITE && p == 0 && (r.odds != 0 ||
+                       (phase == LATE_PARASITE_PHASE && (r.stay != early.stay || early.odds != 0))))
+                        return false;
+                }
+    return true;
+}
+
+static_assert(validRules<PARASITES_RULES>(), "PARASITES_RULES changes the state cycle or adds random events without parasites");
+
+// Stato successivo della cella c con una lettura della tabella; il numero casuale serve solo se la
+// cella ha un evento e dipende da generazione e posizione globale della cella
+template<class R>
+inline cell_t applyRule(const RuleTable<R> &t, int phase, cell_t s, int grass, int parasites,
+                        int c, const RowContext &ctx)
+{
+    uint8_t e = t.entry[phase][s][grass][parasites];
+    if((e >> 6) != 0 && philox(ctx.seed, ctx.gen, ctx.row, ctx.col0 + c) < t.threshold[e >> 6])
+        return (cell_t)((e >> 3) & 7);
+    return (cell_t)(e & 7);
+}
+
+inline void verticalSums(const cell_t *up, const cell_t *mid, const cell_t *down, int c, RowScratch &s)
+{
+    s.grass[c] = (up[c] == GROWN_GRASS) + (mid[c] == GROWN_GRASS) + (down[c] == GROWN_GRASS);
+    s.parasites[c] = (up[c] == PARASITE) + (mid[c] == PARASITE) + (down[c] == PARASITE);
+}
+
+// Celle da from a to-1 della riga con le regole R (somme verticali già calcolate)
+template<class R>
+inline void transCells(const cell_t *mid, cell_t *out, int from, int to, const RowContext &ctx, RowScratch &s)
+{
+    const RuleTable<R> &table = ruleTable<R>();
+    int phase = R::phase(ctx.gen);
+
+    for(int c = from; c < to; ++c) {
+        int grass = s.grass[c-1] + s.grass[c] + s.grass[c+1];
+        int parasites = s.parasites[c-1] + s.parasites[c] + s.parasites[c+1];
+        out[c] = applyRule(table, phase, mid[c], grass, parasites, c, ctx);
+    }
+}
+
+// Conteggio delle transizioni delle celle da from a to-1 (limitate alla finestra di s)
+inline void countRow(const cell_t *mid, const cell_t *out, int from, int to, RowScratch &s)
+{
+    if(s.counts == NULL)
+        return;
+    if(from < s.countFrom)
+        from = s.countFrom;
+    if(to > s.countTo)
+        to = s.countTo;
+
+    for(int c = from; c < to; ++c) {
+        s.counts[SEEDING] += mid[c] == EMPTY && out[c] == SEEDED_GRASS;
+        s.counts[SPROUTING] += mid[c] == SEEDED_GRASS && out[c] == GROWING_GRASS;
+        s.counts[RIPENING] += mid[c] == GROWING_GRASS && out[c] == GROWN_GRASS;
+        s.counts[INFECTION] += mid[c] == GROWN_GRASS && out[c] == PARASITE;
+        s.counts[DEATH] += mid[c] == PARASITE && out[c] == EMPTY;
+    }
+}
+
+// Bit delle celle da c a c+31 che cadono nella finestra di conteggio
+inline uint32_t countMask(int c, const RowScratch &s)
+{
+    long lo = (long)s.countFrom - c, hi = (long)s.countTo - c;
+    if(lo <= 0 && hi >= 32)
+        return 0xFFFFFFFFu;
+    if(lo < 0)
+        lo = 0;
+    if(hi > 32)
+        hi = 32;
+    return lo < hi ? (uint32_t)(((1ull << hi) - 1) & ~((1ull << lo) - 1)) : 0;
+}
+
+template<class R>
+inline void transRowScalar(const cell_t *up, const cell_t *mid, const cell_t *down,
+                           cell_t *out, int cols, const RowContext &ctx, RowScratch &s)
+{
+    for(int c = -1; c <= cols; ++c)
+        verticalSums(up, mid, down, c, s);
+
+    transCells<R>(mid, out, 0, cols, ctx, s);
+    countRow(mid, out, 0, cols, s);
+}
+
+// Aggiunge ai contatori le celle della maschera (un byte 0xFF per cella) che cadono nella finestra
+__attribute__((target("avx2,popcnt")))
+inline void countMasked(uint64_t *counts, int transition, __m256i mask, uint32_t window)
+{
+    counts[transition] += _mm_popcnt_u32((uint32_t)_mm256_movemask_epi8(mask) & window);
+}
+
+// Somme verticali delle colonne da -1 a cols, 32 alla volta: i confronti danno 0xFF (cioè -1)
+// per ogni cella che soddisfa lo stato
+__attribute__((target("avx2")))
+inline void verticalSumsAVX2(const cell_t *up, const cell_t *mid, const cell_t *down, int cols, RowScratch &s)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i grown = _mm256_set1_epi8(GROWN_GRASS);
+    const __m256i parasite = _mm256_set1_epi8(PARASITE);
+    int c;
+
+    for(c = -1; c + 32 <= cols + 1; c += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(up + c));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(mid + c));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(down + c));
+
+        __m256i g = _mm256_add_epi8(_mm256_add_epi8(_mm256_cmpeq_epi8(a, grown), _mm256_cmpeq_epi8(b, grown)), _mm256_cmpeq_epi8(d, grown));
+        __m256i p = _mm256_add_epi8(_mm256_add_epi8(_mm256_cmpeq_epi8(a, parasite), _mm256_cmpeq_epi8(b, parasite)), _mm256_cmpeq_epi8(d, parasite));
+
+        _mm256_storeu_si256((__m256i*)(s.grass + c), _mm256_sub_epi8(zero, g));
+        _mm256_storeu_si256((__m256i*)(s.parasites + c), _mm256_sub_epi8(zero, p));
+    }
+    for(; c <= cols; ++c)
+        verticalSums(up, mid, down, c, s);
+}
+
+// Kernel AVX2 per regole qualsiasi: somme verticali vettoriali, poi una lettura della tabella per cella
+template<class R>
+struct AVX2Rows {
+    __attribute__((target("avx2,popcnt")))
+    static void row(const cell_t *up, const cell_t *mid, const cell_t *down,
+                    cell_t *out, int cols, const RowContext &ctx, RowScratch &s)
+    {
+        verticalSumsAVX2(up, mid, down, cols, s);
+        transCells<R>(mid, out, 0, cols, ctx, s);
+        countRow(mid, out, 0, cols, s);
+    }
+};
+
+// Specializzazione per ParasiteRules (le regole predefinite e le loro varianti con altre soglie):
+// le regole sono applicate a 32 celle alla volta con confronti e blend, senza tabella
+template<int SeedMin, int Crowding, int InfectionOdds, int LateDeathOdds, int LateDeathGen>
+struct AVX2Rows<ParasiteRules<SeedMin, Crowding, InfectionOdds, LateDeathOdds, LateDeathGen> > {
+    typedef ParasiteRules<SeedMin, Crowding, InfectionOdds, LateDeathOdds, LateDeathGen> R;
+
+    __attribute__((target("avx2,popcnt")))
+    static void row(const cell_t *up, const cell_t *mid, const cell_t *down,
+                    cell_t *out, int cols, const RowContext &ctx, RowScratch &s)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i grown = _mm256_set1_epi8(GROWN_GRASS);
+        const __m256i parasite = _mm256_set1_epi8(PARASITE);
+        const uint32_t infection = R::threshold(R::INFECTION_EVENT);
+        const uint32_t lateDeath = R::threshold(R::LATE_DEATH_EVENT);
+        int c;
+
+        verticalSumsAVX2(up, mid, down, cols, s);
+
+        // Somme orizzontali e regole
+        for(c = 0; c + 32 <= cols; c += 32) {
+            __m256i g = _mm256_add_epi8(_mm256_add_epi8(
+                            _mm256_loadu_si256((const __m256i*)(s.grass + c - 1)),
+                            _mm256_loadu_si256((const __m256i*)(s.grass + c))),
+                            _mm256_loadu_si256((const __m256i*)(s.grass + c + 1)));
+            __m256i p = _mm256_add_epi8(_mm256_add_epi8(
+                            _mm256_loadu_si256((const __m256i*)(s.parasites + c - 1)),
+                            _mm256_loadu_si256((const __m256i*)(s.parasites + c))),
+                            _mm256_loadu_si256((const __m256i*)(s.parasites + c + 1)));
+            __m256i st = _mm256_loadu_si256((const __m256i*)(mid + c));
+            __m256i res;
+
+            if(ctx.gen % 2 == 0) {
+                __m256i grows = _mm256_or_si256(_mm256_cmpeq_epi8(st, _mm256_set1_epi8(SEEDED_GRASS)),
+                                                _mm256_cmpeq_epi8(st, _mm256_set1_epi8(GROWING_GRASS)));
+                __m256i seeds = _mm256_and_si256(_mm256_cmpeq_epi8(st, zero),
+                                                 _mm256_cmpgt_epi8(g, _mm256_set1_epi8(SeedMin - 1)));
+                res = _mm256_sub_epi8(st, grows);
+                res = _mm256_blendv_epi8(res, _mm256_set1_epi8(SEEDED_GRASS), seeds);
+
+                uint32_t window;
+                __m256i changed = _mm256_or_si256(seeds, grows);
+                if(s.counts && !_mm256_testz_si256(changed, changed) && (window = countMask(c, s)) != 0) {
+                    countMasked(s.counts, SEEDING, seeds, window);
+                    countMasked(s.counts, SPROUTING, _mm256_cmpeq_epi8(st, _mm256_set1_epi8(SEEDED_GRASS)), window);
+                    countMasked(s.counts, RIPENING, _mm256_cmpeq_epi8(st, _mm256_set1_epi8(GROWING_GRASS)), window);
+                }
+            }
+            else {
+                __m256i isParasite = _mm256_cmpeq_epi8(st, parasite);
+                __m256i attacked = _mm256_andnot_si256(_mm256_cmpeq_epi8(p, zero), _mm256_cmpeq_epi8(st, grown));
+                __m256i dies = _mm256_and_si256(isParasite,
+                                                _mm256_or_si256(_mm256_cmpgt_epi8(p, _mm256_set1_epi8(Crowding - 1)),
+                                                                _mm256_cmpeq_epi8(g, zero)));
+
+                __m256i infects = zero;
+
+                // I numeri casuali servono solo se nel blocco c'è almeno un parassita o una preda attaccata
+                if(!_mm256_testz_si256(_mm256_or_si256(isParasite, attacked), _mm256_or_si256(isParasite, attacked))) {
+                    __m256i u[4];
+                    philox32(ctx.seed, ctx.gen, ctx.row, ctx.col0 + c, u);
+
+                    infects = _mm256_and_si256(attacked, belowThreshold32(u, infection));
+                    if(ctx.gen > LateDeathGen)
+                        dies = _mm256_or_si256(dies, _mm256_and_si256(isParasite, belowThreshold32(u, lateDeath)));
+
+                    // Le celle che muoiono diventano EMPTY, le prede infettate diventano PARASITE
+                    res = _mm256_blendv_epi8(_mm256_andnot_si256(dies, st), parasite, infects);
+                }
+                else res = _mm256_andnot_si256(dies, st);
+
+                uint32_t window;
+                __m256i changed = _mm256_or_si256(infects, dies);
+                if(s.counts && !_mm256_testz_si256(changed, changed) && (window = countMask(c, s)) != 0) {
+                    countMasked(s.counts, INFECTION, infects, window);
+                    countMasked(s.counts, DEATH, dies, window);
+                }
+            }
+            _mm256_storeu_si256((__m256i*)(out + c), res);
+        }
+        transCells<R>(mid, out, c, cols, ctx, s);
+        countRow(mid, out, c, cols, s);
+    }
+};
+
+// Selezione del kernel a runtime per le regole R: AVX2 se disponibile, altrimenti scalare
+template<class R = PARASITES_RULES>
+inline RowKernel selectKernel(bool forceScalar, const char **name)
+{
+    if(!forceScalar && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        *name = "avx2";
+        return AVX2Rows<R>::row;
+    }
+    *name = "scalar";
+    return transRowScalar<R>;
+}
+
+#endif
@@ -1,146 +1,705 @@
 
 // Compile and run:
-//  > mpicc parasites.cpp -lallegro -lallegro_primitives
+//  > mpicxx -pthread parasites.cpp -lallegro
 //  > mpirun -np 4 ./a.out
+//
+// Modalità benchmark (senza display, parametri a runtime):
+//  > mpirun -np 4 ./a.out --headless --rows 2000 --cols 2000 --steps 500 --seed 42
+// Al termine il processo 0 stampa una riga "BENCH key=value ..." leggibile da script.
+//
+// La griglia è divisa in blocchi su una griglia 2D di processi (MPI_Dims_create, oppure
+// --dims RxC; ad esempio --dims 4x1 ripristina la divisione per sole righe). Le dimensioni
+// non devono essere divisibili per il numero di processi: i blocchi differiscono al più di una riga/colonna.
+//
+// Ogni processo può usare più thread (--threads N, compilando con -pthread): il blocco locale è
+// diviso in tile di --tile-rows x --tile-cols celle distribuiti con work stealing (workpool.h). Il thread
+// principale è l'unico a chiamare MPI (MPI_THREAD_FUNNELED) e fa avanzare lo scambio dei bordi
+// mentre tutti i thread calcolano la zona interna.
+//  > mpicxx -O2 -pthread parasites.cpp -lallegro
+//  > mpirun -np 2 --bind-to socket ./a.out --headless --threads 8 --pin
+//
+// Con --halo-depth K la cornice è profonda K celle: i bordi vengono scambiati ogni K generazioni
+// e nelle generazioni intermedie ogni processo ricalcola da sé una parte della cornice, sempre
+// più stretta (scambiando meno messaggi al prezzo di qualche cella calcolata due volte).
+//
+// La zona interna di un tile viene ricalcolata solo se nel tile o nei tile adiacenti qualcosa è
+// cambiato nelle ultime due generazioni o c'è un parassita (--dense ricalcola sempre tutto).
+//
+// Sul processo 0 la grafica gira in un thread separato, che disegna l'ultima generazione ricevuta
+// (snapshot.h): la simulazione non aspetta il disegno e i frame che il display non fa in tempo
+// a mostrare vengono scartati. Il disegno passa da una texture (render.h), sottocampionata se la
+// griglia è più grande della finestra.
+//
+// La griglia viene raccolta sul processo 0 solo ogni --output-every N generazioni (0 = mai;
+// per default ad ogni generazione con la grafica e mai in modalità headless), con un gather non
+// bloccante che si completa mentre i processi calcolano la generazione successiva.
+//
+// Con --fuse T ogni processo calcola T generazioni per passata sulla memoria (temporal.h),
+// usando una cornice profonda (--halo-depth, per default T) scambiata ogni --halo-depth generazioni.
+//
+// Checkpoint e ripartenza con MPI-IO (checkpoint.h): ogni N generazioni tutti i processi scrivono
+// insieme la griglia in un solo file, senza fermare la simulazione; il file può essere riletto con
+// un numero qualsiasi di processi.
+//  > mpirun -np 8 ./a.out --headless --steps 100000 --checkpoint run.ckpt --checkpoint-every 1000
+//  > mpirun -np 4 ./a.out --headless --steps 100000 --restart run.ckpt --checkpoint run.ckpt --checkpoint-every 1000
+//
+// Con --record FILE il processo 0 registra ogni generazione raccolta (record.h, per default
+// tutte), da rivedere poi con replay.cpp:
+//  > mpirun -np 8 ./a.out --headless --steps 5000 --record run.rec --output-every 10
+//
+// Con --stats FILE il processo 0 scrive in CSV la popolazione di ogni stato e le transizioni di
+// ogni generazione (stats.h), senza raccogliere la griglia: il kernel conta le transizioni delle
+// celle locali e le righe di --stats-every N generazioni vengono sommate con un solo MPI_Reduce.
+//  > mpirun -np 8 ./a.out --headless --steps 5000 --stats run.csv --stats-every 500
+//
+// Ogni fase della generazione viene cronometrata (profile.h). Con --profile il processo 0 stampa,
+// per ogni fase, tempo minimo, medio e massimo tra i processi, il processo più lento, lo
+// sbilanciamento e l'istogramma delle durate; --trace FILE scrive tutte le fasi di tutti i
+// processi in un file JSON da aprire con chrome://tracing o ui.perfetto.dev.
+//  > mpirun -np 8 ./a.out --headless --steps 500 --profile --trace run.json
+//
+// Per default i bordi della griglia sono chiusi (le celle fuori dalla griglia sono EMPTY); con --torus
+// la griglia si richiude su sé stessa: la topologia cartesiana è periodica, i processi ai bordi
+// scambiano la cornice con quelli del lato opposto e, se il vicino in una direzione è il processo
+// stesso (una sola riga o colonna di processi), la cornice viene copiata localmente senza messaggi.
+//  > mpirun -np 4 ./a.out --headless --torus --dims 4x1
+//
+// Con --rebalance-every N i confini tra le righe di processi vengono spostati a runtime: ogni N
+// generazioni si confronta il tempo di calcolo delle righe di processi e, se sono sbilanciate, le
+// righe della griglia migrano verso quelle più veloci (le colonne restano divise in parti uguali).
+//  > mpirun -np 8 ./a.out --headless --rows 4000 --steps 5000 --dims 8x1 --rebalance-every 100
+//
+// Con --shared-halo i due buffer di ogni processo stanno in finestre MPI-3 condivise tra i processi
+// dello stesso nodo (MPI_Win_allocate_shared): i vicini sullo stesso nodo si scambiano solo un
+// messaggio vuoto ("il mio buffer è pronto") e copiano la cornice direttamente dal blocco dell'altro,
+// i messaggi con i bordi restano solo tra nodi diversi. Anche il processo 0 copia i blocchi dei
+// processi del suo nodo per il gather, che via MPI raccoglie solo quelli degli altri nodi.
+//  > mpirun -np 16 ./a.out --headless --rows 8000 --steps 1000 --shared-halo
+//
+// La grafica mostra un viewport (viewport.h) che si sposta trascinando con il mouse o con le frecce
+// e si ingrandisce con la rotella o con +/- (Home torna all'intera griglia). Il processo 0 invia il
+// viewport a tutti con il messaggio di controllo; ogni processo riduce la parte che possiede (lo
+// stato più frequente di ogni blocco di celle) e invia solo quei pixel, quindi il gather non supera
+// mai i pixel della finestra, qualunque sia la griglia. Con --record serve la griglia intera: il
+// gather resta completo e il viewport viene ridotto dal thread di disegno.
+//  > mpirun -np 16 ./a.out --rows 50000 --cols 50000 --output-every 10
 
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <getopt.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <allegro5/allegro.h>
-#include <allegro5/allegro_primitives.h>
+#include <future>
 #include "mpi.h"
+#include "kernel.h"
+#include "rng.h"
+#include "workpool.h"
+#include "snapshot.h"
+#include "render.h"
+#include "temporal.h"
+#include "checkpoint.h"
+#include "record.h"
+#include "stats.h"
+#include "profile.h"
+#include "viewport.h"
 
-#define STEPS 1000
-#define SIZE_CELL 4
 #define TITLE "Parasites - Emanuele Conforti (220270)"
 
 inline void init();
 inline void finalize();
-inline void transFunction(int row, int col);
+inline void transFunction(int row, int col, int n, int thread);
+inline void blockRange(int n, int parts, int index, int *offset, int *size);
+inline void rowRange(int procRow, int *offset, int *rows);
+inline void unpackGather(cell_t *dest);
+inline void startGather(int gen);
+inline int openRestart();
+inline void readRestart();
+inline void startCheckpoint(int gen);
+inline void completeCheckpoint();
+inline void completeGather();
+inline void startStats();
+inline void collectStats(int steps);
+inline void reduceStats();
 inline void transFunctionBorders();
 inline void transFunctionInside();
+inline void fusedPass(int steps);
+inline void markActiveTiles();
+inline void trackTiles(int r, int c, int n);
 inline int coords(int r, int c);
+inline int parseArgs(int argc, char** argv);
+inline void printBench();
+inline void reportProfile();
+inline void saveTrace();
 
 // Allegro graphics
 inline int init_allegro();
 inline void finalize_allegro();
-inline void print();
+inline void print(const cell_t *frame, const Viewport &frameView);
+inline void renderLoop(std::promise<int> *started);
 
 // MPI
 inline void MPI_sendBorders();
 inline void MPI_recvBorders();
+inline void copySelfBorders();
+inline void copySharedBorders();
+inline void gatherShared();
+inline void allocLocalMatrices();
+inline void freeLocalMatrices();
+inline int borderOffset(int d, int rows, int cols, bool send);
 inline void swap();
-
-// Stati in cui si può trovare una cella: 
-// -EMPTY
-// -PARASITE è il predatore
-// -GRASS è la preda, ha 3 sotto-stati: SEEDED, GROWING, GROWN
-// 
-// Transizioni di stato: 
-// EMPTY -> SEEDED -> GROWING -> GROWN -> PARASITE -> EMPTY...
-
-enum states {EMPTY = 0, PARASITE, SEEDED_GRASS, GROWING_GRASS, GROWN_GRASS};
-
-int ROWS = 300, COLS, end = 0, *localReadMatrix, *localWriteMatrix, *matrix, GEN = 0;
+inline void initNeighbors();
+inline void initHaloPlan();
+inline void freeHaloPlan();
+inline void initLayout();
+inline void freeLayout();
+inline void rebalance();
+inline void migrateRows(const int *starts);
+inline void startControl();
+inline void completeControl();
+inline void startViewGather();
+inline void unpackViewGather(cell_t *dest);
+inline void handleViewEvent(const ALLEGRO_EVENT &event);
+
+// Stati, tipo delle celle e kernel di riga sono definiti in kernel.h.
+// Le celle occupano un byte: matrici locali, bordi e gather spostano 4 volte meno memoria
+#define MPI_CELL MPI_UINT8_T
+
+inline cell_t* allocMatrix(size_t cells, bool zero = true);
+inline void firstTouch();
+inline void freeMatrix(cell_t* m);
+
+int ROWS = 300, COLS = 0, STEPS = 1000, SIZE_CELL = 4, end = 0, GEN = 0;
+cell_t *localReadMatrix, *localWriteMatrix, *matrix;
+
+// Blocco locale: localRows x localCols celle a partire dalla cella globale (rowOffset, colOffset),
+// memorizzate con una cornice di haloDepth celle fantasma per lato (righe e colonne da 1-haloDepth
+// a 0 e da localRows+1 / localCols+1 in poi) che contiene i bordi ricevuti dai vicini, oppure
+// EMPTY ai bordi della griglia. stride è la lunghezza di una riga memorizzata
+int localRows, localCols, rowOffset, colOffset, haloDepth = 0, stride;
+
+// Confini delle righe di processi: la riga di processi p possiede le righe globali da rowStarts[p]
+// a rowStarts[p+1]-1. All'inizio vengono da blockRange, poi rebalance() può spostarli
+int *rowStarts;
+
+// Generazioni trascorse dall'ultimo scambio dei bordi (da 0 a haloDepth-1)
+int haloPhase = 0;
+
+// Messaggi e byte inviati per lo scambio dei bordi da questo processo
+long haloMessages = 0, haloBytes = 0;
+
+// Zona interna: celle che non hanno celle fantasma ricevute come vicine,
+// calcolabili mentre lo scambio dei bordi è in corso
+int insideTop, insideBottom, insideLeft, insideRight;
+
+// Opzioni da riga di comando: headless disattiva la grafica (e quindi la pausa di print()),
+// seed rende la sequenza casuale ripetibile
+bool headless = false, hugePages = false, forceScalar = false;
+unsigned seed;
+
+// Bordi periodici (--torus) invece della cornice EMPTY ai bordi della griglia
+bool torus = false;
+
+// Kernel di riga scelto a runtime (AVX2 o scalare) e buffer di lavoro di ogni thread
+RowKernel transRow;
+const char *kernelName;
+RowScratch *scratch;
+
+// Thread di ogni processo e dimensioni dei tile
+int threadCount = 1, tileRows = 8, tileCols = 128;
+bool pinThreads = false;
+WorkPool *pool;
+
+// Stato dei tile (tilesY x tilesX, in ordine di riga): i bit dicono se il tile è cambiato
+// nell'ultima generazione, se era cambiato in quella prima e se contiene un parassita.
+// tileActive indica i tile la cui zona interna va ricalcolata nella generazione corrente
+#define TILE_CHANGED 1
+#define TILE_CHANGED_BEFORE 2
+#define TILE_PARASITE 4
+
+int tilesY, tilesX;
+uint8_t *tileState, *tileActive;
+bool denseTiles = false;
+long activeTiles = 0, totalTiles = 0;
+
+// Checkpoint: file (scritto prima come file.tmp e rinominato a scrittura completata), ogni quante
+// generazioni e file da cui ripartire. checkpointType è il blocco locale all'interno della griglia
+// globale del file; il blocco viene copiato in checkpointBuffer e scritto mentre la simulazione prosegue
+const char *checkpointPath = NULL, *restartPath = NULL;
+int checkpointEvery = 0, startGen = 0;
+char checkpointTemp[4096];
+MPI_Datatype checkpointType;
+MPI_File checkpointFile, restartFile;
+MPI_Request checkpointRequest = MPI_REQUEST_NULL;
+bool checkpointPending = false;
+CheckpointHeader checkpointHeader;
+cell_t *checkpointBuffer;
+long checkpoints = 0;
+
+// Registrazione compressa delle generazioni raccolte dal processo 0
+const char *recordPath = NULL;
+Recorder recorder;
+
+// Statistiche di popolazione: ogni thread conta in threadCounts le transizioni delle celle locali,
+// una riga di TRANSITION_COUNT contatori per ogni generazione della passata. statsRow è la riga
+// locale della generazione corrente; le righe accumulate in statsBuffer (con le generazioni in
+// statsGens) vengono sommate sul processo 0 ogni statsEvery generazioni
+const char *statsPath = NULL;
+int statsEvery = 100, statsRows = 0;
+uint64_t *threadCounts, *statsBuffer;
+uint64_t statsRow[STATS_FIELDS];
+int *statsGens;
+StatsWriter stats;
+long statsReductions = 0;
+
+// Profilo delle fasi di ogni generazione (profile.h): il report con --profile, la traccia con --trace.
+// loadImbalance è il rapporto tra il tempo di calcolo massimo e quello medio tra i processi
+PhaseProfiler profiler;
+bool profileReport = false;
+const char *tracePath = NULL;
+double loadImbalance = 1;
+
+// Bilanciamento dinamico del carico: ogni rebalanceEvery generazioni (0 = mai) si confronta il
+// tempo di calcolo delle righe di processi dall'ultimo bilanciamento (rebalanceCompute è il totale
+// di questo processo a quel momento); le righe migrano solo se il massimo supera la media di più
+// di REBALANCE_THRESHOLD. colComm contiene i processi della stessa colonna della griglia di processi
+#define REBALANCE_THRESHOLD 1.05
+int rebalanceEvery = 0;
+bool rebalanceDue = false;
+double rebalanceCompute = 0;
+MPI_Comm colComm;
+long rebalances = 0, rowsMoved = 0;
+
+// Blocking temporale: generazioni per passata (1 = una generazione alla volta), colonne per
+// striscia (0 = scelte in base alla cache L2) e buffer di ogni thread
+int fuseSteps = 1, stripWidth = 0;
+FusedScratch *fusedScratch;
+
+// Numero di allocazioni delle matrici: il ciclo principale non deve farne nessuna, salvo quando
+// rebalance() sposta le righe e ricrea i blocchi locali
+long allocations = 0, loopAllocations = 0;
 
 // Nelle iterazioni con GEN % 2 == 0, faccio sviluppare solo l'erba
 // mentre nelle iterazioni con GEN % 2 != 0, faccio sviluppare solo i parassiti
 
 
-// Allegro graphics
+// Allegro graphics: display e coda degli eventi appartengono al thread di disegno, che riceve
+// le generazioni da frames e segnala al ciclo principale la chiusura della finestra
 ALLEGRO_DISPLAY *display;
-ALLEGRO_EVENT event;
 ALLEGRO_EVENT_QUEUE *queue;
+FrameRenderer *renderer;
+SnapshotRing *frames;
+std::thread renderThread;
+std::atomic<bool> windowClosed(false);
+
+// Viewport della grafica (viewport.h) in una finestra di windowWidth x windowHeight pixel.
+// Il thread di disegno scrive in requestedView quello scelto dall'utente (shownView è il suo, quello
+// che disegna), il processo 0 lo manda a tutti con il messaggio di controllo e view è quello in uso,
+// uguale su tutti i processi. Con viewGather (grafica senza --record) il gather raccoglie solo
+// l'immagine ridotta di gatherView: ogni processo riduce in viewBuffer la parte del suo blocco e il
+// processo 0 tiene in viewSpans i pixel di ogni processo. viewImage è l'immagine ridotta dal thread
+// di disegno quando riceve la griglia intera
+int windowWidth, windowHeight;
+Viewport view, requestedView, shownView, gatherView;
+std::mutex viewLock;
+bool viewGather = false, dragging = false;
+cell_t *viewBuffer, *viewImage;
+int *viewSpans;
 
 // MPI
-MPI_Datatype borderType;
+enum directions {NORTH = 0, SOUTH, WEST, EAST, NORTH_WEST, NORTH_EAST, SOUTH_WEST, SOUTH_EAST};
+const int opposite[8] = {SOUTH, NORTH, EAST, WEST, SOUTH_EAST, SOUTH_WEST, NORTH_EAST, NORTH_WEST};
+const int dirRow[8] = {-1, 1, 0, 0, -1, -1, 1, 1};
+const int dirCol[8] = {0, 0, -1, 1, -1, 1, -1, 1};
+
+MPI_Datatype rowBorderType, colBorderType, cornerType;
 MPI_Datatype localMatrixType;
 MPI_Comm comm;
-int rank, nthreads, upNeighbor, downNeighbor;
-// double start_time, end_time;
+int rank, nthreads;
+int dims[2] = {0, 0}, procCoords[2];
+
+// Per ogni direzione: rank del vicino (MPI_PROC_NULL ai bordi della griglia, salvo con --torus),
+// datatype del bordo, posizione del bordo inviato e della cornice in cui viene ricevuto quello del
+// vicino, righe e colonne del bordo (per le copie locali quando il vicino è il processo stesso)
+int neighbors[8], sendOffset[8], recvOffset[8];
+int haloRows[8], haloCols[8];
+MPI_Datatype haloType[8];
+
+// Piano di comunicazione dei bordi: richieste persistenti (8 ricezioni e 8 invii) create una sola
+// volta per ciascuno dei due buffer, haloBuffer[b] è il buffer letto dal piano haloPlan[b].
+// haloRequests punta al piano avviato per ultimo
+MPI_Request haloPlan[2][16];
+cell_t *haloBuffer[2];
+MPI_Request *haloRequests = haloPlan[0];
+long haloPlanMessages = 0, haloPlanBytes = 0;
+
+// Scambio dei bordi in memoria condivisa (--shared-halo). nodeComm contiene i processi dello stesso
+// nodo e nodeRanks[r] è il rank in nodeComm del processo r di comm (MPI_UNDEFINED se è su un altro
+// nodo); matrixWindow[b] è la finestra condivisa di haloBuffer[b]. sharedSource[b][d] è il bordo del
+// vicino nella direzione d da copiare nella cornice quando si legge haloBuffer[b] (NULL se arriva con
+// MPI), sharedStride[d] la lunghezza delle righe del vicino. Se tra due scambi ci sono più passate
+// (haloDepth > fuseSteps), i vicini si segnalano anche la fine della copia con sharedRelease prima
+// di riscrivere il buffer letto dall'altro. sharedBytes sono i byte della cornice copiati dai vicini
+bool sharedHalo = false, sharedReleaseNeeded = false;
+MPI_Comm nodeComm = MPI_COMM_NULL;
+int *nodeRanks;
+MPI_Win matrixWindow[2];
+const cell_t *sharedSource[2][8];
+int sharedStride[8];
+MPI_Request sharedRelease[16];
+long sharedPlanBytes = 0, sharedBytes = 0;
+
+// Stato di controllo deciso dal processo 0 e inviato a tutti ad ogni generazione con un solo
+// broadcast non bloccante, che si completa durante la generazione successiva
+enum controls {CONTROL_END = 0, CONTROL_VIEW_TOP, CONTROL_VIEW_LEFT, CONTROL_VIEW_ROWS, CONTROL_VIEW_COLS,
+               CONTROL_VIEW_SCALE, CONTROL_COUNT};
+int control[CONTROL_COUNT];
+MPI_Request controlRequest = MPI_REQUEST_NULL;
+bool controlPending = false;
+
+// Gather verso il processo 0: i blocchi arrivano compatti in gatherBuffer e vengono copiati in matrix
+// (o nell'istantanea da disegnare). Un solo gather alla volta, ogni outputEvery generazioni;
+// gatherGen è la generazione che sta raccogliendo. gatherPending resta vero finché il processo 0
+// non ha copiato il risultato, anche se la richiesta è già stata completata da un MPI_Test
+int *gatherCounts, *gatherDispls;
+cell_t *gatherBuffer;
+MPI_Request gatherRequest = MPI_REQUEST_NULL;
+bool gatherPending = false;
+int outputEvery = -1, gatherGen;
+long gathers = 0, gatherBytes = 0;
+
+// Timer delle fasi (misurati dal processo 0): inizializzazione, calcolo (funzione di
+// transizione + scambio dei bordi), output (gather + stampa + broadcast di controllo)
+double start_time, loop_time, end_time, compute_time = 0, output_time = 0;
 
 int main(int argc, char** argv){
 
-    MPI_Init(&argc, &argv);
-    
-    // if(rank == 0)
-    //     start_time = MPI_Wtime();
+    // Solo il thread principale chiama MPI, anche quando il processo usa più thread
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &nthreads);
 
-    while(ROWS%nthreads!=0) {ROWS--;}
-    COLS = ROWS;
+    seed = (unsigned)time(NULL);
+    if(parseArgs(argc, argv) == -1){
+        MPI_Finalize();
+        return -1;
+    }
+
+    if(provided < MPI_THREAD_FUNNELED && threadCount > 1){
+        if(rank == 0)
+            printf("Warning: MPI_THREAD_FUNNELED not supported, using 1 thread per process\n");
+        threadCount = 1;
+    }
+
+    // Il seed del processo 0 viene usato da tutti, così --seed basta su un solo processo
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+
+    start_time = MPI_Wtime();
+
+    // Ripartendo da un checkpoint, dimensioni, generazione e seed sono quelli del file
+    if(restartPath && openRestart() == -1){
+        MPI_Finalize();
+        return -1;
+    }
+
+    if(COLS == 0)
+        COLS = ROWS;
+
+    // All'inizio il viewport mostra l'intera griglia
+    windowSize(ROWS, COLS, SIZE_CELL, &windowWidth, &windowHeight);
+    view = requestedView = shownView = fullView(ROWS, COLS, windowWidth, windowHeight);
+    viewGather = !headless && !recordPath;
+
+    // Creazione di una topologia cartesiana 2D: ogni processo riceve un blocco di righe e colonne.
+    // Le dimensioni della griglia non devono essere divisibili per quelle della griglia di processi
+    MPI_Dims_create(nthreads, 2, dims);
+    if(ROWS < dims[0] || COLS < dims[1]){
+        if(rank == 0)
+            printf("Error: the grid is smaller than the %dx%d process grid!\n", dims[0], dims[1]);
+        MPI_Finalize();
+        return -1;
+    }
+
+    int periods[2] = {torus, torus};
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &comm);
+    MPI_Cart_coords(comm, rank, 2, procCoords);
+
+    // Comunicatore della colonna di processi, in cui il rank è la riga di processi (per rebalance())
+    int remainDims[2] = {1, 0};
+    MPI_Cart_sub(comm, remainDims, &colComm);
+
+    rowStarts = (int*) malloc((dims[0]+1)*sizeof(int));
+    for(int p = 0, rows; p < dims[0]; ++p)
+        blockRange(ROWS, dims[0], p, &rowStarts[p], &rows);
+    rowStarts[dims[0]] = ROWS;
+
+    rowRange(procCoords[0], &rowOffset, &localRows);
+    blockRange(COLS, dims[1], procCoords[1], &colOffset, &localCols);
+    stride = localCols + 2*haloDepth;
+
+    // La cornice viene dai soli vicini diretti, quindi nessun blocco può essere più sottile di haloDepth
+    int thinnest = localRows < localCols ? localRows : localCols;
+    MPI_Allreduce(MPI_IN_PLACE, &thinnest, 1, MPI_INT, MPI_MIN, comm);
+    if(thinnest < haloDepth){
+        if(rank == 0)
+            printf("Error: --halo-depth %d is larger than the smallest block (%d cells)!\n", haloDepth, thinnest);
+        MPI_Finalize();
+        return -1;
+    }
     
     // Generatore di numeri casuali
     // I numeri casuali serviranno nella funzione di transizione
     // per fare in modo che i predatori non mangino tutte le prede o non muoiano.
     // In pratica, aiutano a raggiungere un equilibrio tra le due parti, in modo da
     // rendere il programma infinito.
-    srand((unsigned)time(NULL) + rank);
+    // Il generatore (rng.h) è basato su contatore: ogni cella usa (seed, GEN, riga e colonna globali),
+    // quindi la griglia non dipende dal numero di processi ed è identica a quella della versione seriale.
+
+    pool = new WorkPool(threadCount, pinThreads);
+
+    // Processi dello stesso nodo, per lo scambio dei bordi in memoria condivisa
+    if(sharedHalo){
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+        MPI_Group commGroup, nodeGroup;
+        MPI_Comm_group(comm, &commGroup);
+        MPI_Comm_group(nodeComm, &nodeGroup);
+        int *ranks = (int*) malloc(nthreads*sizeof(int));
+        nodeRanks = (int*) malloc(nthreads*sizeof(int));
+        for(int r = 0; r < nthreads; ++r)
+            ranks[r] = r;
+        MPI_Group_translate_ranks(commGroup, nthreads, ranks, nodeGroup, nodeRanks);
+        MPI_Group_free(&commGroup);
+        MPI_Group_free(&nodeGroup);
+        free(ranks);
+        sharedReleaseNeeded = haloDepth > fuseSteps;
+    }
 
-    localReadMatrix = (int*) calloc((ROWS/nthreads+2)*COLS,sizeof(int));
-    localWriteMatrix = (int*) calloc((ROWS/nthreads+2)*COLS,sizeof(int));
+    // Due buffer persistenti, allocati una sola volta e scambiati per puntatore in swap()
+    allocLocalMatrices();
 
-    int dimensions[1] = {nthreads};
-    int periods[1] = {0};
-    
-    // Creazione di una topologia cartesiana 1D (ad una dimensione)
-    MPI_Cart_create(MPI_COMM_WORLD, 1, dimensions, periods, 0, &comm);
-    MPI_Cart_shift(comm, 0, 1, &upNeighbor, &downNeighbor);
-
-    // Inizializzazione di due datatype: borderType rappresenta una riga della matrice
-    // e serve ad inviare i bordi tra processi; localMatrixType rappresenta un'intera
-    // sotto-matrice locale ad un processo e serve ad inviare le sotto-matrici locali
-    // al processo 0 per la stampa (tramite Gather)
-    MPI_Type_contiguous(COLS, MPI_INT, &borderType);
-    MPI_Type_contiguous((ROWS/nthreads)*COLS, MPI_INT, &localMatrixType);
-    MPI_Type_commit(&borderType);
-    MPI_Type_commit(&localMatrixType);
+    transRow = selectKernel(forceScalar, &kernelName);
+    scratch = (RowScratch*) malloc(threadCount*sizeof(RowScratch));
+    for(int t = 0; t < threadCount; ++t)
+        scratch[t] = makeScratch(allocMatrix(scratchSize(stride)), stride);
+
+    if(fuseSteps > 1){
+        fusedScratch = (FusedScratch*) malloc(threadCount*sizeof(FusedScratch));
+        for(int t = 0; t < threadCount; ++t)
+            fusedScratch[t] = makeFusedScratch(allocMatrix(fusedScratchSize(stride)), stride);
+        if(stripWidth == 0)
+            stripWidth = fusedStripWidth(localCols, fuseSteps, threadCount);
+    }
+
+    if(statsPath){
+        threadCounts = (uint64_t*) calloc((size_t)threadCount*FUSED_MAX*TRANSITION_COUNT, sizeof(uint64_t));
+        statsBuffer = (uint64_t*) malloc((size_t)(statsEvery + FUSED_MAX)*STATS_FIELDS*sizeof(uint64_t));
+        statsGens = (int*) malloc((statsEvery + FUSED_MAX)*sizeof(int));
+        for(int t = 0; t < threadCount; ++t){
+            scratch[t].counts = threadCounts + (size_t)t*FUSED_MAX*TRANSITION_COUNT;
+            if(fuseSteps > 1)
+                fusedScratch[t].counts = scratch[t].counts;
+        }
+    }
+
+    // Con viewGather nessun buffer dipende dalla dimensione della griglia, solo da quella della finestra
+    size_t frameCells = viewGather ? (size_t)windowWidth*windowHeight : (size_t)ROWS*COLS;
+    if(viewGather)
+        viewBuffer = allocMatrix(frameCells);
 
     if(rank == 0){
-        matrix = (int*) calloc(ROWS*COLS, sizeof(int));
-        if(init_allegro() == -1)
+        matrix = viewGather ? NULL : allocMatrix(ROWS*COLS);
+        gatherBuffer = allocMatrix(frameCells);
+        gatherCounts = (int*) malloc(nthreads*sizeof(int));
+        gatherDispls = (int*) malloc(nthreads*sizeof(int));
+        viewSpans = (int*) malloc(4*nthreads*sizeof(int));
+
+        if(recordPath && !recorder.open(recordPath, ROWS, COLS, seed)){
+            printf("Error: cannot create recording %s!\n", recordPath);
             MPI_Abort(comm, -1);
+        }
+
+        if(statsPath && !stats.open(statsPath)){
+            printf("Error: cannot create statistics file %s!\n", statsPath);
+            MPI_Abort(comm, -1);
+        }
+
+        if(!headless){
+            frames = new SnapshotRing(frameCells);
+            std::promise<int> started;
+            std::future<int> result = started.get_future();
+            renderThread = std::thread(renderLoop, &started);
+            if(result.get() == -1){
+                renderThread.join();
+                MPI_Abort(comm, -1);
+            }
+        }
+    }
+
+    initLayout();
+
+    if(restartPath)
+        readRestart();
+    else
+        init();
+    if(statsPath)
+        startStats();
+
+    // Con la traccia, l'origine dei tempi è la stessa su tutti i processi
+    if(tracePath){
+        MPI_Barrier(comm);
+        profiler.enableTrace();
     }
+    profiler.setOrigin();
 
-    init();
+    loop_time = MPI_Wtime();
+    long allocationsBeforeLoop = allocations;
 
     while(!end && GEN < STEPS){
 
-        MPI_sendBorders();       // Invio ASINCRONO dei bordi: ogni processo invia i bordi, 
+        double phase_time = MPI_Wtime();
+        int advance = STEPS - GEN < fuseSteps ? STEPS - GEN : fuseSteps;
+        profiler.setGeneration(GEN);
+
+        if(fuseSteps > 1){
+            // Blocking temporale: dopo lo scambio dei bordi (se è il momento), advance generazioni
+            // in una sola passata su tutto il blocco e sulla parte ancora valida della cornice
+            if(haloPhase == 0){
+                profiler.begin(PHASE_HALO_START);
+                MPI_sendBorders();
+                profiler.end(PHASE_HALO_START);
+                profiler.begin(PHASE_HALO_WAIT);
+                MPI_recvBorders();
+                profiler.end(PHASE_HALO_WAIT);
+            }
+            profiler.begin(PHASE_FUSED);
+            fusedPass(advance);
+            profiler.end(PHASE_FUSED);
+        }
+        else{
+            profiler.begin(PHASE_MARK);
+            markActiveTiles();       // Si scelgono i tile da ricalcolare,
+            profiler.end(PHASE_MARK);
+
+            if(haloPhase == 0){
+                profiler.begin(PHASE_HALO_START);
+                MPI_sendBorders();   // si inviano in modo ASINCRONO i bordi (ogni haloDepth generazioni),
+                profiler.end(PHASE_HALO_START);
+            }
 
-        transFunctionInside();   // poi esegue la funzione di transizione sulle celle interne,
+            profiler.begin(PHASE_INSIDE);
+            transFunctionInside();   // si esegue la funzione di transizione sulle celle interne dei tile attivi,
+            profiler.end(PHASE_INSIDE);
 
-        MPI_recvBorders();       // riceve i bordi dai processi vicini
+            if(haloPhase == 0){
+                profiler.begin(PHASE_HALO_WAIT);
+                MPI_recvBorders();   // si ricevono i bordi dai processi vicini
+                profiler.end(PHASE_HALO_WAIT);
+            }
 
-        transFunctionBorders();  // e applica la funzione di transizione alle celle rimanenti 
-                                 // (sfruttando i bordi appena ricevuti)
+            profiler.begin(PHASE_BORDERS);
+            transFunctionBorders();  // e si applica la funzione di transizione alle celle rimanenti 
+                                     // (sfruttando i bordi appena ricevuti)
+            profiler.end(PHASE_BORDERS);
+        }
+        profiler.begin(PHASE_SWAP);
         swap();     
-
-        // Ogni processo invia la sua sotto-matrice locale al processo con rank 0, che si occuperà della stampa
-        MPI_Gather(&localReadMatrix[coords(1,0)], 1, localMatrixType, matrix, 1, localMatrixType, 0, comm);
+        profiler.end(PHASE_SWAP);
+        haloPhase = (haloPhase + advance) % haloDepth;
+
+        double output_start = MPI_Wtime();
+        compute_time += output_start - phase_time;
+
+        // Il gather della generazione precedente deve terminare prima che il suo buffer venga riscritto
+        // (alla prossima generazione); poi, se è il momento, ogni processo inizia ad inviare la sua
+        // sotto-matrice locale al processo con rank 0, che si occuperà della stampa
+        // (con --fuse, se la passata ha superato un multiplo di outputEvery)
+        profiler.begin(PHASE_GATHER);
+        completeGather();
+        if(outputEvery > 0 && ((GEN+advance) / outputEvery > GEN / outputEvery || GEN+advance == STEPS))
+            startGather(GEN+advance);
+        profiler.end(PHASE_GATHER);
+
+        // Il checkpoint precedente deve terminare prima di riusare checkpointBuffer
+        if(checkpointEvery > 0 && (GEN+advance) / checkpointEvery > GEN / checkpointEvery){
+            profiler.begin(PHASE_CHECKPOINT);
+            completeCheckpoint();
+            startCheckpoint(GEN+advance);
+            profiler.end(PHASE_CHECKPOINT);
+        }
         
-        if(rank == 0){
-            print();
-            al_peek_next_event(queue, &event);
-            if(event.type == ALLEGRO_EVENT_DISPLAY_CLOSE)
-                end = 1; 
-            GEN++;                        
+        // Le statistiche vengono sommate sul processo 0 ogni statsEvery generazioni
+        if(statsPath){
+            profiler.begin(PHASE_STATS);
+            collectStats(advance);
+            if(statsRows >= statsEvery)
+                reduceStats();
+            profiler.end(PHASE_STATS);
         }
 
-        MPI_Bcast(&GEN, 1, MPI_INT, 0, comm);
-        MPI_Bcast(&end, 1, MPI_INT, 0, comm);
+        // GEN avanza allo stesso modo su tutti i processi; end arriva dal processo 0 con il messaggio
+        // di controllo della generazione precedente, così tutti i processi si fermano insieme
+        GEN += advance;
+        profiler.begin(PHASE_CONTROL);
+        completeControl();
+        startControl();
+        profiler.end(PHASE_CONTROL);
+
+        output_time += MPI_Wtime() - output_start;
+
+        // Bilanciamento del carico ogni rebalanceEvery generazioni, al primo scambio dei bordi utile
+        if(rebalanceEvery > 0 && GEN / rebalanceEvery > (GEN-advance) / rebalanceEvery)
+            rebalanceDue = true;
+        if(rebalanceDue && haloPhase == 0 && !end && GEN < STEPS){
+            profiler.begin(PHASE_REBALANCE);
+            rebalance();
+            profiler.end(PHASE_REBALANCE);
+            rebalanceDue = false;
+        }
     }
 
+    completeGather();
+    completeControl();
+    completeCheckpoint();
+    if(statsPath)
+        reduceStats();
+
+    // Nel report compare il massimo tra tutti i processi
+    long localLoopAllocations = allocations - allocationsBeforeLoop;
+    MPI_Reduce(&localLoopAllocations, &loopAllocations, 1, MPI_LONG, MPI_MAX, 0, comm);
+
+    // Traffico dei bordi (messaggi e copie dalla memoria condivisa) sommato su tutti i processi
+    long haloTotals[3] = {haloMessages, haloBytes, sharedBytes};
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : haloTotals, haloTotals, 3, MPI_LONG, MPI_SUM, 0, comm);
+    haloMessages = haloTotals[0];
+    haloBytes = haloTotals[1];
+    sharedBytes = haloTotals[2];
+
+    // Tile attivi sommati su tutti i processi e su tutte le generazioni
+    long tileTotals[2] = {activeTiles, totalTiles};
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : tileTotals, tileTotals, 2, MPI_LONG, MPI_SUM, 0, comm);
+    activeTiles = tileTotals[0];
+    totalTiles = tileTotals[1];
+
+    // Tempi delle fasi di tutti i processi (sbilanciamento del carico, ed eventualmente il report)
+    reportProfile();
+
     if(rank == 0) {
-        // end_time = MPI_Wtime();
+        end_time = MPI_Wtime();
         printf("ROWS: %d --- COLS: %d\n", ROWS, COLS);
         printf("STEPS: %d\n", GEN);
-        // printf("%d thread --- Time: %lf\n", nthreads, (end_time - start_time)*1000);
+        printBench();
     }    
 
+    if(tracePath)
+        saveTrace();
+
     finalize();
 
     MPI_Finalize();
@@ -148,12 +707,14 @@ int main(int argc, char** argv){
     return 0;
 }
 
-// L'inizializzazione prevede una matrice di GROWN_GRASS e un PARASITE al centro
+// L'inizializzazione prevede una matrice di GROWN_GRASS e un PARASITE al centro.
+// Il centro è calcolato sulla griglia globale, come nella versione seriale,
+// così la posizione del PARASITE non dipende dal numero di processi
 inline void init()
 {
-    for(int i = 1; i <= (ROWS/nthreads); i++) {
-        for(int j = 0; j < COLS; j++) {
-            if(rank == (nthreads/2) && i == 1 && j == (COLS/2)) {
+    for(int i = 1; i <= localRows; i++) {
+        for(int j = 1; j <= localCols; j++) {
+            if(rowOffset + i-1 == (ROWS/2) && colOffset + j-1 == (COLS/2)) {
                 localReadMatrix[coords(i,j)] = PARASITE;
             }
             else localReadMatrix[coords(i,j)] = GROWN_GRASS;
@@ -161,7 +722,729 @@ inline void init()
     }
 }
 
-int coords(int r, int c) { return (r*COLS+c); }  // per trasformare gli indici di matrice in indici di array
+// per trasformare gli indici di matrice in indici di array: (1,1) è la prima cella del blocco locale,
+// la cornice va da 1-haloDepth a 0 e da localRows+1 (o localCols+1) a localRows+haloDepth
+int coords(int r, int c) { return ((r+haloDepth-1)*stride + c+haloDepth-1); }
+
+// Divisione di n righe (o colonne) in parts blocchi: i primi n % parts blocchi hanno un elemento in più
+void blockRange(int n, int parts, int index, int *offset, int *size){
+    *size = n/parts + (index < n%parts);
+    *offset = index*(n/parts) + (index < n%parts ? index : n%parts);
+}
+
+// Righe globali della riga di processi procRow (dai confini correnti, vedi rebalance())
+void rowRange(int procRow, int *offset, int *rows){
+    *offset = rowStarts[procRow];
+    *rows = rowStarts[procRow+1] - rowStarts[procRow];
+}
+
+// Strutture che dipendono dalle dimensioni del blocco locale: datatype, vicini e piano dei bordi,
+// tile, tipo del blocco nel file di checkpoint e (sul processo 0) i blocchi da raccogliere.
+// Vengono ricreate da migrateRows() quando il bilanciamento cambia i confini delle righe
+void initLayout(){
+    // Inizializzazione dei datatype: rowBorderType rappresenta haloDepth righe del blocco locale
+    // (bordi nord e sud), colBorderType haloDepth colonne (bordi ovest ed est, con passo pari alla
+    // lunghezza della riga), cornerType un angolo di haloDepth x haloDepth celle. localMatrixType
+    // rappresenta l'intero blocco locale senza cornice e serve ad inviarlo al processo 0 per la stampa
+    // (tramite Gatherv)
+    MPI_Type_vector(haloDepth, localCols, stride, MPI_CELL, &rowBorderType);
+    MPI_Type_vector(localRows, haloDepth, stride, MPI_CELL, &colBorderType);
+    MPI_Type_vector(haloDepth, haloDepth, stride, MPI_CELL, &cornerType);
+    MPI_Type_vector(localRows, localCols, stride, MPI_CELL, &localMatrixType);
+    MPI_Type_commit(&rowBorderType);
+    MPI_Type_commit(&colBorderType);
+    MPI_Type_commit(&cornerType);
+    MPI_Type_commit(&localMatrixType);
+
+    initNeighbors();
+    initHaloPlan();
+
+    // All'inizio (e dopo ogni bilanciamento) tutti i tile sono attivi per due generazioni
+    tilesY = (localRows + tileRows - 1) / tileRows;
+    tilesX = (localCols + tileCols - 1) / tileCols;
+    tileState = (uint8_t*) malloc((size_t)tilesY*tilesX);
+    tileActive = (uint8_t*) malloc((size_t)tilesY*tilesX);
+    memset(tileState, TILE_CHANGED | TILE_CHANGED_BEFORE | TILE_PARASITE, (size_t)tilesY*tilesX);
+
+    // Tipo del blocco locale nel file: sotto-matrice della griglia globale (dopo l'header)
+    int globalSizes[2] = {ROWS, COLS}, localSizes[2] = {localRows, localCols}, starts[2] = {rowOffset, colOffset};
+    MPI_Type_create_subarray(2, globalSizes, localSizes, starts, MPI_ORDER_C, MPI_CELL, &checkpointType);
+    MPI_Type_commit(&checkpointType);
+    if(checkpointEvery > 0)
+        checkpointBuffer = allocMatrix((size_t)localRows*localCols);
+
+    if(rank == 0){
+        for(int r = 0, displ = 0; r < nthreads; ++r){
+            int c[2], offset, rows, cols;
+            MPI_Cart_coords(comm, r, 2, c);
+            rowRange(c[0], &offset, &rows);
+            blockRange(COLS, dims[1], c[1], &offset, &cols);
+            // con --shared-halo i blocchi dei processi del nodo vengono copiati da gatherShared()
+            gatherCounts[r] = sharedHalo && r != 0 && nodeRanks[r] != MPI_UNDEFINED ? 0 : rows*cols;
+            gatherDispls[r] = displ;
+            displ += rows*cols;
+        }
+    }
+}
+
+void freeLayout(){
+    MPI_Type_free(&rowBorderType);
+    MPI_Type_free(&colBorderType);
+    MPI_Type_free(&cornerType);
+    MPI_Type_free(&localMatrixType);
+    freeHaloPlan();
+    free(tileState);
+    free(tileActive);
+    MPI_Type_free(&checkpointType);
+    if(checkpointEvery > 0)
+        freeMatrix(checkpointBuffer);
+}
+
+// Vicini nelle 8 direzioni e posizioni dei bordi da inviare e ricevere.
+// Si determina anche la zona interna: lungo i lati senza vicino la cornice resta EMPTY,
+// quindi anche la prima (o ultima) riga/colonna può essere calcolata senza attendere i bordi
+void initNeighbors(){
+    const int *dr = dirRow, *dc = dirCol;
+
+    for(int d = 0; d < 8; ++d){
+        int c[2] = {procCoords[0] + dr[d], procCoords[1] + dc[d]};
+
+        // con --torus la topologia è periodica e MPI_Cart_rank riporta le coordinate nella griglia
+        if(!torus && (c[0] < 0 || c[0] >= dims[0] || c[1] < 0 || c[1] >= dims[1]))
+            neighbors[d] = MPI_PROC_NULL;
+        else
+            MPI_Cart_rank(comm, c, &neighbors[d]);
+
+        haloType[d] = dr[d] == 0 ? colBorderType : dc[d] == 0 ? rowBorderType : cornerType;
+        sendOffset[d] = borderOffset(d, localRows, localCols, true);
+        recvOffset[d] = borderOffset(d, localRows, localCols, false);
+        haloRows[d] = dr[d] == 0 ? localRows : haloDepth;
+        haloCols[d] = dc[d] == 0 ? localCols : haloDepth;
+    }
+
+    insideTop = neighbors[NORTH] == MPI_PROC_NULL ? 1 : 2;
+    insideBottom = neighbors[SOUTH] == MPI_PROC_NULL ? localRows : localRows-1;
+    insideLeft = neighbors[WEST] == MPI_PROC_NULL ? 1 : 2;
+    insideRight = neighbors[EAST] == MPI_PROC_NULL ? localCols : localCols-1;
+}
+
+// Posizione del bordo inviato nella direzione d (le prime o le ultime haloDepth righe/colonne) o della
+// cornice in cui si riceve quello del vicino, in un blocco di rows x cols celle con cornice haloDepth.
+// Serve anche per i blocchi dei vicini sullo stesso nodo, che hanno dimensioni diverse
+int borderOffset(int d, int rows, int cols, bool send){
+    int row, col;
+    if(send){
+        row = dirRow[d] < 0 ? 1 : rows-haloDepth+1;
+        col = dirCol[d] < 0 ? 1 : cols-haloDepth+1;
+    }
+    else{
+        row = dirRow[d] < 0 ? 1-haloDepth : rows+1;
+        col = dirCol[d] < 0 ? 1-haloDepth : cols+1;
+    }
+    if(dirRow[d] == 0)
+        row = 1;
+    if(dirCol[d] == 0)
+        col = 1;
+    return (row+haloDepth-1)*(cols+2*haloDepth) + col+haloDepth-1;
+}
+
+// Gather non bloccante della generazione gen appena calcolata (in localReadMatrix dopo swap())
+void startGather(int gen){
+    gatherGen = gen;
+    gatherPending = true;
+    gathers++;
+    gatherView = view;
+
+    if(viewGather){
+        startViewGather();
+        return;
+    }
+    if(rank == 0)
+        gatherBytes += (long)ROWS*COLS*sizeof(cell_t);
+
+    bool shared = sharedHalo && nodeRanks[0] != MPI_UNDEFINED;
+    if(shared)
+        gatherShared();
+    MPI_Igatherv(&localReadMatrix[coords(1,1)], shared && rank != 0 ? 0 : 1, localMatrixType,
+                 gatherBuffer, gatherCounts, gatherDispls, MPI_CELL, 0, comm, &gatherRequest);
+}
+
+// Con --shared-halo il processo 0 copia in gatherBuffer i blocchi dei processi del suo nodo
+// direttamente dalle loro finestre, senza messaggi. La copia è sincrona: i processi del nodo
+// aspettano che finisca prima di riscrivere il buffer appena calcolato
+void gatherShared(){
+    int b = localReadMatrix == haloBuffer[0] ? 0 : 1;
+    MPI_Win_sync(matrixWindow[b]);
+    MPI_Barrier(nodeComm);
+
+    if(rank == 0){
+        MPI_Win_sync(matrixWindow[b]);
+        for(int r = 1; r < nthreads; ++r){
+            if(nodeRanks[r] == MPI_UNDEFINED)
+                continue;
+
+            int c[2], offset, rows, cols, unit;
+            MPI_Aint size;
+            cell_t *base;
+            MPI_Cart_coords(comm, r, 2, c);
+            rowRange(c[0], &offset, &rows);
+            blockRange(COLS, dims[1], c[1], &offset, &cols);
+            MPI_Win_shared_query(matrixWindow[b], nodeRanks[r], &size, &unit, &base);
+
+            size_t blockStride = cols + 2*haloDepth;
+            const cell_t *from = base + haloDepth*blockStride + haloDepth;
+            for(int i = 0; i < rows; ++i)
+                memcpy(gatherBuffer + gatherDispls[r] + (size_t)i*cols, from + i*blockStride, cols*sizeof(cell_t));
+        }
+    }
+    MPI_Barrier(nodeComm);
+}
+
+// Attesa del gather in corso (se c'è); il processo 0 copia la generazione raccolta in matrix,
+// oppure in un'istantanea per il thread di disegno, che la mostrerà appena libero, e la registra
+void completeGather(){
+    if(!gatherPending)
+        return;
+
+    MPI_Wait(&gatherRequest, MPI_STATUS_IGNORE);
+    gatherPending = false;
+    if(rank == 0){
+        cell_t *frame = headless ? matrix : frames->acquire();
+        if(viewGather)
+            unpackViewGather(frame);
+        else
+            unpackGather(frame);
+        if(recorder.isOpen())
+            recorder.write(frame, COLS, gatherGen);
+        if(!headless)
+            frames->publish(gatherGen, gatherView);
+    }
+}
+
+// Gather dell'immagine ridotta del viewport in uso: ogni processo riduce la parte del suo blocco
+// (divisa tra i thread a gruppi di righe di pixel) e invia solo i suoi pixel. Il processo 0 ricava
+// i pixel di ogni processo dai confini dei blocchi, senza messaggi in più
+void startViewGather(){
+    static int span[4];
+    viewSpan(view.top, view.rows, view.scale, rowOffset, rowOffset+localRows, &span[0], &span[1]);
+    viewSpan(view.left, view.cols, view.scale, colOffset, colOffset+localCols, &span[2], &span[3]);
+
+    auto band = [](int t, int thread){
+        const Viewport &v = gatherView;
+        int first = span[0] + t*tileRows, last = first + tileRows < span[1] ? first + tileRows : span[1];
+        int top = v.top + first*v.scale, bottom = v.top + last*v.scale;
+        bottom = bottom < rowOffset+localRows ? bottom : rowOffset+localRows;
+        int zone[4];
+        reduceZone(&localReadMatrix[coords(top-rowOffset+1, 1)], stride, top, colOffset, bottom-top, localCols, v,
+                   viewBuffer + (size_t)(first-span[0])*(span[3]-span[2]), zone);
+    };
+    if(span[3] > span[2])
+        pool->run((span[1] - span[0] + tileRows - 1) / tileRows, band);
+
+    if(rank == 0){
+        for(int r = 0, displ = 0; r < nthreads; ++r){
+            int c[2], rowOff, rows, colOff, cols, *s = viewSpans + 4*r;
+            MPI_Cart_coords(comm, r, 2, c);
+            rowRange(c[0], &rowOff, &rows);
+            blockRange(COLS, dims[1], c[1], &colOff, &cols);
+            viewSpan(view.top, view.rows, view.scale, rowOff, rowOff+rows, &s[0], &s[1]);
+            viewSpan(view.left, view.cols, view.scale, colOff, colOff+cols, &s[2], &s[3]);
+            gatherCounts[r] = (s[1]-s[0])*(s[3]-s[2]);
+            gatherDispls[r] = displ;
+            displ += gatherCounts[r];
+        }
+        gatherBytes += (long)viewRows(view)*viewCols(view)*sizeof(cell_t);
+    }
+    MPI_Igatherv(viewBuffer, (span[1]-span[0])*(span[3]-span[2]), MPI_CELL, gatherBuffer, gatherCounts, gatherDispls,
+                 MPI_CELL, 0, comm, &gatherRequest);
+}
+
+// Copia dei pixel ricevuti (compatti, in ordine di rank) nell'immagine ridotta dest (viewCols(gatherView) per riga)
+void unpackViewGather(cell_t *dest){
+    int width = viewCols(gatherView);
+    for(int r = 0; r < nthreads; ++r){
+        const int *s = viewSpans + 4*r;
+        int cols = s[3] - s[2];
+        for(int y = s[0]; y < s[1]; ++y)
+            memcpy(dest + (size_t)y*width + s[2], gatherBuffer + gatherDispls[r] + (size_t)(y-s[0])*cols, cols);
+    }
+}
+
+// Popolazione iniziale del blocco locale: prima riga di statistiche (senza transizioni)
+void startStats(){
+    for(int i = 1; i <= localRows; ++i)
+        countStates(&localReadMatrix[coords(i,1)], localCols, statsRow);
+
+    memcpy(statsBuffer, statsRow, sizeof(statsRow));
+    statsGens[0] = GEN;
+    statsRows = 1;
+}
+
+// Una riga di statistiche locali per ognuna delle steps generazioni appena calcolate, sommando
+// le transizioni contate dai thread (che vengono azzerate per la passata successiva)
+void collectStats(int steps){
+    for(int k = 0; k < steps; ++k){
+        uint64_t t[TRANSITION_COUNT] = {0};
+        for(int thread = 0; thread < threadCount; ++thread){
+            uint64_t *counts = threadCounts + ((size_t)thread*FUSED_MAX + k)*TRANSITION_COUNT;
+            for(int i = 0; i < TRANSITION_COUNT; ++i)
+                t[i] += counts[i];
+            memset(counts, 0, TRANSITION_COUNT*sizeof(uint64_t));
+        }
+
+        applyTransitions(statsRow, t);
+        memcpy(statsBuffer + (size_t)statsRows*STATS_FIELDS, statsRow, sizeof(statsRow));
+        statsGens[statsRows++] = GEN + k + 1;
+    }
+}
+
+// Somma delle righe accumulate da tutti i processi sul processo 0, che le scrive nel file
+void reduceStats(){
+    if(statsRows == 0)
+        return;
+
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : statsBuffer, statsBuffer, statsRows*STATS_FIELDS, MPI_UINT64_T, MPI_SUM, 0, comm);
+    if(rank == 0)
+        for(int i = 0; i < statsRows; ++i)
+            stats.write(statsGens[i], statsBuffer + (size_t)i*STATS_FIELDS);
+    statsRows = 0;
+    statsReductions++;
+}
+
+// Apertura del checkpoint da cui ripartire e lettura dell'header (su tutti i processi)
+int openRestart(){
+    CheckpointHeader header;
+
+    if(MPI_File_open(MPI_COMM_WORLD, restartPath, MPI_MODE_RDONLY, MPI_INFO_NULL, &restartFile) != MPI_SUCCESS){
+        if(rank == 0)
+            printf("Error: cannot open checkpoint %s!\n", restartPath);
+        return -1;
+    }
+    MPI_File_read_at_all(restartFile, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    if(!validCheckpointHeader(header)){
+        if(rank == 0)
+            printf("Error: %s is not a valid checkpoint!\n", restartPath);
+        MPI_File_close(&restartFile);
+        return -1;
+    }
+
+    ROWS = header.rows;
+    COLS = header.cols;
+    GEN = startGen = header.gen;
+    seed = header.seed;
+    return 0;
+}
+
+// Lettura collettiva del blocco locale dal checkpoint, al posto di init()
+void readRestart(){
+    MPI_File_set_view(restartFile, CHECKPOINT_HEADER_SIZE, MPI_CELL, checkpointType, "native", MPI_INFO_NULL);
+    MPI_File_read_at_all(restartFile, 0, &localReadMatrix[coords(1,1)], 1, localMatrixType, MPI_STATUS_IGNORE);
+    MPI_File_close(&restartFile);
+}
+
+// Checkpoint della generazione gen (in localReadMatrix dopo swap()): il blocco locale viene copiato
+// in checkpointBuffer e scritto con una scrittura collettiva non bloccante, che si completa mentre
+// la simulazione prosegue. L'header è scritto dal processo 0
+void startCheckpoint(int gen){
+    for(int i = 0; i < localRows; ++i)
+        memcpy(checkpointBuffer + (size_t)i*localCols, &localReadMatrix[coords(i+1,1)], localCols);
+
+    snprintf(checkpointTemp, sizeof(checkpointTemp), "%s.tmp", checkpointPath);
+    if(MPI_File_open(comm, checkpointTemp, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &checkpointFile) != MPI_SUCCESS){
+        if(rank == 0)
+            printf("Error: cannot create checkpoint %s!\n", checkpointTemp);
+        MPI_Abort(comm, -1);
+    }
+    MPI_File_set_size(checkpointFile, CHECKPOINT_HEADER_SIZE + (MPI_Offset)ROWS*COLS*sizeof(cell_t));
+
+    if(rank == 0){
+        checkpointHeader = makeCheckpointHeader(ROWS, COLS, gen, seed);
+        MPI_File_write_at(checkpointFile, 0, &checkpointHeader, sizeof(checkpointHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+    MPI_File_set_view(checkpointFile, CHECKPOINT_HEADER_SIZE, MPI_CELL, checkpointType, "native", MPI_INFO_NULL);
+    MPI_File_iwrite_at_all(checkpointFile, 0, checkpointBuffer, localRows*localCols, MPI_CELL, &checkpointRequest);
+    checkpointPending = true;
+}
+
+// Attesa del checkpoint in corso (se c'è): quando tutti i processi hanno chiuso il file,
+// il processo 0 lo rinomina, così il file di checkpoint è sempre completo
+void completeCheckpoint(){
+    if(!checkpointPending)
+        return;
+
+    MPI_Wait(&checkpointRequest, MPI_STATUS_IGNORE);
+    MPI_File_close(&checkpointFile);
+    MPI_Barrier(comm);
+    if(rank == 0 && rename(checkpointTemp, checkpointPath) != 0)
+        printf("Warning: cannot rename %s to %s!\n", checkpointTemp, checkpointPath);
+    checkpointPending = false;
+    checkpoints++;
+}
+
+// Copia dei blocchi ricevuti dal Gatherv (compatti, in ordine di rank) nella matrice globale dest
+void unpackGather(cell_t *dest){
+    for(int r = 0; r < nthreads; ++r){
+        int c[2], rowOff, rows, colOff, cols;
+        MPI_Cart_coords(comm, r, 2, c);
+        rowRange(c[0], &rowOff, &rows);
+        blockRange(COLS, dims[1], c[1], &colOff, &cols);
+
+        for(int i = 0; i < rows; ++i)
+            memcpy(dest + (size_t)(rowOff+i)*COLS + colOff, gatherBuffer + gatherDispls[r] + (size_t)i*cols, cols);
+    }
+}
+
+// Bilanciamento delle righe tra le righe di processi, chiamato con haloPhase == 0 (lo scambio dei
+// bordi successivo riempie la cornice dei nuovi blocchi). Il costo di una riga di processi è il
+// tempo di calcolo massimo tra i suoi processi dall'ultimo bilanciamento, distribuito in modo
+// uniforme sulle sue righe: il confine k andrebbe dove il costo accumulato raggiunge k/dims[0] del
+// totale, ma si sposta solo di metà della distanza, per non oscillare inseguendo il rumore.
+// Tutti i processi ricevono gli stessi costi con MPI_Allreduce, quindi scelgono gli stessi confini
+void rebalance(){
+    const double *t = profiler.total();
+    double compute = t[PHASE_MARK] + t[PHASE_INSIDE] + t[PHASE_BORDERS] + t[PHASE_FUSED];
+    double *cost = (double*) calloc(dims[0], sizeof(double));
+    cost[procCoords[0]] = compute - rebalanceCompute;
+    rebalanceCompute = compute;
+    MPI_Allreduce(MPI_IN_PLACE, cost, dims[0], MPI_DOUBLE, MPI_MAX, comm);
+
+    double total = 0, max = 0;
+    for(int p = 0; p < dims[0]; ++p){
+        total += cost[p];
+        max = cost[p] > max ? cost[p] : max;
+    }
+    if(total <= 0 || max <= REBALANCE_THRESHOLD * total / dims[0]){
+        free(cost);
+        return;
+    }
+
+    // Ogni riga di processi tiene almeno haloDepth righe, perché la cornice viene dai soli vicini diretti
+    int *starts = (int*) malloc((dims[0]+1)*sizeof(int));
+    starts[0] = 0;
+    starts[dims[0]] = ROWS;
+    double accumulated = 0;
+    for(int k = 1, p = 0; k < dims[0]; ++k){
+        double target = total * k / dims[0];
+        while(p < dims[0]-1 && accumulated + cost[p] < target)
+            accumulated += cost[p++];
+
+        double ideal = rowStarts[p];
+        if(cost[p] > 0)
+            ideal += (target - accumulated) / cost[p] * (rowStarts[p+1] - rowStarts[p]);
+        starts[k] = rowStarts[k] + (int)lround((ideal - rowStarts[k]) / 2);
+
+        int lowest = starts[k-1] + haloDepth, highest = ROWS - (dims[0]-k)*haloDepth;
+        starts[k] = starts[k] < lowest ? lowest : starts[k] > highest ? highest : starts[k];
+    }
+    free(cost);
+
+    long moved = 0;
+    for(int k = 1; k < dims[0]; ++k)
+        moved += labs(starts[k] - rowStarts[k]);
+    if(moved > 0){
+        // Gather e checkpoint in corso leggono il blocco con le dimensioni attuali
+        completeGather();
+        completeCheckpoint();
+        migrateRows(starts);
+
+        // Popolazione del nuovo blocco locale (la somma tra i processi non cambia)
+        if(statsPath){
+            memset(statsRow, 0, STATE_COUNT*sizeof(uint64_t));
+            for(int i = 1; i <= localRows; ++i)
+                countStates(&localReadMatrix[coords(i,1)], localCols, statsRow);
+        }
+        rebalances++;
+        rowsMoved += moved;
+    }
+    free(starts);
+}
+
+// Spostamento del blocco locale ai nuovi confini starts: ogni processo invia ai processi della sua
+// colonna (colComm, in cui il rank è la riga di processi) le righe che passano a loro, tutte con un
+// solo MPI_Alltoallv sui blocchi compattati; poi matrici locali e strutture del blocco vengono ricreate
+void migrateRows(const int *starts){
+    int newOffset = starts[procCoords[0]], newRows = starts[procCoords[0]+1] - newOffset;
+    int *sendCounts = (int*) malloc(4*dims[0]*sizeof(int));
+    int *sendDispls = sendCounts + dims[0], *recvCounts = sendCounts + 2*dims[0], *recvDispls = sendCounts + 3*dims[0];
+
+    for(int p = 0; p < dims[0]; ++p){
+        // righe del blocco attuale che passano alla riga di processi p
+        int from = rowOffset > starts[p] ? rowOffset : starts[p];
+        int to = rowOffset+localRows < starts[p+1] ? rowOffset+localRows : starts[p+1];
+        sendCounts[p] = to > from ? (to-from)*localCols : 0;
+        sendDispls[p] = to > from ? (from-rowOffset)*localCols : 0;
+
+        // righe del nuovo blocco che arrivano dalla riga di processi p
+        from = newOffset > rowStarts[p] ? newOffset : rowStarts[p];
+        to = newOffset+newRows < rowStarts[p+1] ? newOffset+newRows : rowStarts[p+1];
+        recvCounts[p] = to > from ? (to-from)*localCols : 0;
+        recvDispls[p] = to > from ? (from-newOffset)*localCols : 0;
+    }
+
+    cell_t *sendBuffer = allocMatrix((size_t)localRows*localCols, false);
+    cell_t *recvBuffer = allocMatrix((size_t)newRows*localCols, false);
+    for(int i = 0; i < localRows; ++i)
+        memcpy(sendBuffer + (size_t)i*localCols, &localReadMatrix[coords(i+1,1)], localCols);
+    MPI_Alltoallv(sendBuffer, sendCounts, sendDispls, MPI_CELL, recvBuffer, recvCounts, recvDispls, MPI_CELL, colComm);
+
+    freeLayout();
+    freeLocalMatrices();
+    memcpy(rowStarts, starts, (dims[0]+1)*sizeof(int));
+    rowOffset = newOffset;
+    localRows = newRows;
+
+    allocLocalMatrices();
+    for(int i = 0; i < localRows; ++i)
+        memcpy(&localReadMatrix[coords(i+1,1)], recvBuffer + (size_t)i*localCols, localCols);
+    initLayout();
+
+    freeMatrix(sendBuffer);
+    freeMatrix(recvBuffer);
+    free(sendCounts);
+}
+
+// Lettura delle opzioni da riga di comando; restituisce -1 se il programma deve terminare
+int parseArgs(int argc, char** argv){
+    static struct option longOptions[] = {
+        {"headless",  no_argument,       0, 'n'},
+        {"rows",      required_argument, 0, 'r'},
+        {"cols",      required_argument, 0, 'c'},
+        {"steps",     required_argument, 0, 's'},
+        {"seed",      required_argument, 0, 'S'},
+        {"cell-size", required_argument, 0, 'z'},
+        {"hugepages", no_argument,       0, 'H'},
+        {"scalar",    no_argument,       0, 'x'},
+        {"dims",      required_argument, 0, 'd'},
+        {"threads",   required_argument, 0, 't'},
+        {"tile-rows", required_argument, 0, 'T'},
+        {"pin",       no_argument,       0, 'p'},
+        {"halo-depth",required_argument, 0, 'k'},
+        {"tile-cols", required_argument, 0, 'C'},
+        {"dense",     no_argument,       0, 'D'},
+        {"output-every", required_argument, 0, 'o'},
+        {"fuse",      required_argument, 0, 'f'},
+        {"strip-cols",required_argument, 0, 'w'},
+        {"checkpoint",required_argument, 0, 'P'},
+        {"checkpoint-every", required_argument, 0, 'E'},
+        {"restart",   required_argument, 0, 'R'},
+        {"record",    required_argument, 0, 'e'},
+        {"stats",     required_argument, 0, 'a'},
+        {"stats-every", required_argument, 0, 'b'},
+        {"profile",   no_argument,       0, 'q'},
+        {"trace",     required_argument, 0, 'j'},
+        {"rebalance-every", required_argument, 0, 'l'},
+        {"torus",     no_argument,       0, 'W'},
+        {"shared-halo", no_argument,     0, 'M'},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    opterr = (rank == 0);   // gli errori di getopt vengono stampati una sola volta
+    while((opt = getopt_long(argc, argv, "nr:c:s:S:z:Hxd:t:T:pk:C:Do:f:w:P:E:R:e:a:b:qj:l:WMh", longOptions, NULL)) != -1){
+        switch(opt){
+            case 'n': headless = true; break;
+            case 'r': ROWS = atoi(optarg); break;
+            case 'c': COLS = atoi(optarg); break;
+            case 's': STEPS = atoi(optarg); break;
+            case 'S': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'z': SIZE_CELL = atoi(optarg); break;
+            case 'H': hugePages = true; break;
+            case 'x': forceScalar = true; break;
+            case 'd':
+                if(sscanf(optarg, "%dx%d", &dims[0], &dims[1]) != 2)
+                    dims[0] = dims[1] = -1;
+                break;
+            case 't': threadCount = atoi(optarg); break;
+            case 'T': tileRows = atoi(optarg); break;
+            case 'p': pinThreads = true; break;
+            case 'k': haloDepth = atoi(optarg); break;
+            case 'C': tileCols = atoi(optarg); break;
+            case 'D': denseTiles = true; break;
+            case 'o': outputEvery = atoi(optarg); break;
+            case 'f': fuseSteps = atoi(optarg); break;
+            case 'w': stripWidth = atoi(optarg); break;
+            case 'P': checkpointPath = optarg; break;
+            case 'E': checkpointEvery = atoi(optarg); break;
+            case 'R': restartPath = optarg; break;
+            case 'e': recordPath = optarg; break;
+            case 'a': statsPath = optarg; break;
+            case 'b': statsEvery = atoi(optarg); break;
+            case 'q': profileReport = true; break;
+            case 'j': tracePath = optarg; break;
+            case 'l': rebalanceEvery = atoi(optarg); break;
+            case 'W': torus = true; break;
+            case 'M': sharedHalo = true; break;
+
+            default:
+                if(rank == 0){
+                    printf("Usage: %s [--headless] [--rows N] [--cols N] [--steps N] [--seed N] [--cell-size PX] [--hugepages] [--scalar] [--dims RxC] [--threads N] [--tile-rows N] [--pin] [--halo-depth K] [--tile-cols N] [--dense] [--output-every N] [--fuse T] [--strip-cols N] [--checkpoint FILE] [--checkpoint-every N] [--restart FILE] [--record FILE] [--stats FILE] [--stats-every N] [--profile] [--trace FILE] [--rebalance-every N] [--torus] [--shared-halo]\n", argv[0]);
+                }
+                return -1;
+        }
+    }
+
+    if(ROWS <= 0 || COLS < 0 || STEPS < 0 || SIZE_CELL <= 0 || threadCount <= 0 || tileRows <= 0 || tileCols <= 0 || haloDepth < 0
+       || fuseSteps <= 0 || fuseSteps > FUSED_MAX || stripWidth < 0 || statsEvery <= 0 || rebalanceEvery < 0){
+        if(rank == 0)
+            printf("Error: invalid grid size, steps, cell size, threads, tile size, halo depth, fuse steps, stats or rebalance interval!\n");
+        return -1;
+    }
+
+    if(checkpointEvery < 0 || (checkpointEvery > 0) != (checkpointPath != NULL)){
+        if(rank == 0)
+            printf("Error: --checkpoint FILE and --checkpoint-every N (> 0) go together!\n");
+        return -1;
+    }
+
+    // Una passata del blocking temporale consuma fuseSteps livelli della cornice: gli scambi dei
+    // bordi devono cadere tra una passata e l'altra. I tile attivi non vengono usati
+    if(haloDepth == 0)
+        haloDepth = fuseSteps;
+    if(haloDepth % fuseSteps != 0){
+        if(rank == 0)
+            printf("Error: --halo-depth must be a multiple of --fuse!\n");
+        return -1;
+    }
+    if(fuseSteps > 1)
+        denseTiles = true;
+
+    if(outputEvery < 0)
+        outputEvery = headless && !recordPath ? 0 : 1;
+
+    // --dims: 0 lascia la dimensione a MPI_Dims_create, che richiede divisori del numero di processi
+    if(dims[0] < 0 || dims[1] < 0 || (dims[0] > 0 && nthreads % dims[0] != 0) || (dims[1] > 0 && nthreads % dims[1] != 0)
+       || (dims[0] > 0 && dims[1] > 0 && dims[0]*dims[1] != nthreads)){
+        if(rank == 0)
+            printf("Error: --dims must be RxC with R*C = %d (0 = automatic)!\n", nthreads);
+        return -1;
+    }
+    return 0;
+}
+
+// Riga di benchmark leggibile da script: tempi in secondi, throughput calcolato sul solo ciclo principale
+void printBench(){
+    double wall = end_time - loop_time;
+    int gens = GEN - startGen;
+    double gensPerSec = wall > 0 ? gens / wall : 0;
+
+    printf("BENCH engine=mpi kernel=%s ranks=%d threads=%d dims=%dx%d rows=%d cols=%d steps=%d seed=%u headless=%d "
+           "wall_s=%.6f init_s=%.6f compute_s=%.6f output_s=%.6f gens_per_s=%.3f cell_updates_per_s=%.6e "
+           "allocs=%ld loop_allocs=%ld steals=%ld halo_depth=%d halo_msgs_per_gen=%.3f halo_bytes_per_gen=%.1f active_tiles=%.4f "
+           "frames_shown=%ld frames_dropped=%ld output_every=%d gathers=%ld gather_bytes=%ld fuse=%d strip_cols=%d start_gen=%d checkpoints=%ld "
+           "record_frames=%ld record_bytes=%ld stats_rows=%ld stats_reductions=%ld imbalance=%.3f rebalances=%ld rows_moved=%ld torus=%d "
+           "shared_halo=%d shared_bytes_per_gen=%.1f\n",
+           kernelName, nthreads, threadCount, dims[0], dims[1], ROWS, COLS, GEN, seed, headless ? 1 : 0,
+           wall, loop_time - start_time, compute_time, output_time,
+           gensPerSec, gensPerSec * (double)ROWS * COLS,
+           allocations, loopAllocations, pool->steals(),
+           haloDepth, gens > 0 ? (double)haloMessages / gens : 0.0, gens > 0 ? (double)haloBytes / gens : 0.0,
+           totalTiles > 0 ? (double)activeTiles / totalTiles : 0.0,
+           frames ? frames->shown() : 0L, frames ? frames->dropped() : 0L,
+           outputEvery, gathers, gatherBytes,
+           fuseSteps, fuseSteps > 1 ? stripWidth : localCols, startGen, checkpoints,
+           recorder.frameCount(), recorder.stored(), stats.rowCount(), statsReductions, loadImbalance, rebalances, rowsMoved, torus ? 1 : 0,
+           sharedHalo ? 1 : 0, gens > 0 ? (double)sharedBytes / gens : 0.0);
+    fflush(stdout);
+}
+
+// Tempi delle fasi raccolti sul processo 0. Lo sbilanciamento è il rapporto tra il massimo e la media
+// tra i processi: per loadImbalance si usa il tempo di calcolo (le fasi in cui un processo lavora
+// sulle proprie celle), perché le attese dei processi veloci compensano i processi lenti.
+// Con --profile, una riga per fase (con l'istogramma delle durate sommato su tutti i processi:
+// "limite:n" sono n fasi durate meno di limite microsecondi) e una riga per processo
+void reportProfile(){
+    double *totals = rank == 0 ? (double*) malloc((size_t)nthreads*PHASE_COUNT*sizeof(double)) : NULL;
+    long histogram[PHASE_COUNT*PROFILE_BUCKETS];
+
+    MPI_Gather(profiler.total(), PHASE_COUNT, MPI_DOUBLE, totals, PHASE_COUNT, MPI_DOUBLE, 0, comm);
+    MPI_Reduce(profiler.buckets(), histogram, PHASE_COUNT*PROFILE_BUCKETS, MPI_LONG, MPI_SUM, 0, comm);
+    if(rank != 0)
+        return;
+
+    double computeMax = 0, computeSum = 0;
+    for(int r = 0; r < nthreads; ++r){
+        const double *t = totals + (size_t)r*PHASE_COUNT;
+        double compute = t[PHASE_MARK] + t[PHASE_INSIDE] + t[PHASE_BORDERS] + t[PHASE_FUSED];
+        computeMax = compute > computeMax ? compute : computeMax;
+        computeSum += compute;
+    }
+    loadImbalance = computeSum > 0 ? computeMax / (computeSum / nthreads) : 1;
+
+    if(profileReport){
+        for(int p = 0; p < PHASE_COUNT; ++p){
+            if(profiler.callCount()[p] == 0)
+                continue;
+
+            double min = totals[p], max = totals[p], sum = 0;
+            int maxRank = 0;
+            for(int r = 0; r < nthreads; ++r){
+                double t = totals[(size_t)r*PHASE_COUNT + p];
+                min = t < min ? t : min;
+                if(t > max){
+                    max = t;
+                    maxRank = r;
+                }
+                sum += t;
+            }
+
+            printf("PROFILE phase=%s calls=%ld min_s=%.6f mean_s=%.6f max_s=%.6f max_rank=%d imbalance=%.3f hist_us=",
+                   phaseNames[p], profiler.callCount()[p], min, sum / nthreads, max, maxRank, sum > 0 ? max / (sum / nthreads) : 1.0);
+            const char *separator = "";
+            for(int b = 0; b < PROFILE_BUCKETS; ++b){
+                if(histogram[p*PROFILE_BUCKETS + b] > 0){
+                    printf("%s%ld:%ld", separator, PhaseProfiler::bucketLimit(b), histogram[p*PROFILE_BUCKETS + b]);
+                    separator = ",";
+                }
+            }
+            printf("\n");
+        }
+
+        for(int r = 0; r < nthreads; ++r){
+            printf("PROFILE_RANK rank=%d", r);
+            for(int p = 0; p < PHASE_COUNT; ++p)
+                if(profiler.callCount()[p] > 0)
+                    printf(" %s_s=%.6f", phaseNames[p], totals[(size_t)r*PHASE_COUNT + p]);
+            printf("\n");
+        }
+        fflush(stdout);
+    }
+    free(totals);
+}
+
+// Raccolta degli eventi della traccia di tutti i processi sul processo 0, che scrive il file
+void saveTrace(){
+    const std::vector<TraceEvent> &events = profiler.trace();
+    int bytes = (int)(events.size()*sizeof(TraceEvent));
+    int *counts = NULL, *displs = NULL;
+    TraceEvent *all = NULL;
+
+    if(rank == 0){
+        counts = (int*) malloc(nthreads*sizeof(int));
+        displs = (int*) malloc((nthreads+1)*sizeof(int));
+    }
+    MPI_Gather(&bytes, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+
+    if(rank == 0){
+        displs[0] = 0;
+        for(int r = 0; r < nthreads; ++r)
+            displs[r+1] = displs[r] + counts[r];
+        all = (TraceEvent*) malloc(displs[nthreads] > 0 ? displs[nthreads] : 1);
+    }
+    MPI_Gatherv(events.data(), bytes, MPI_BYTE, all, counts, displs, MPI_BYTE, 0, comm);
+
+    if(rank == 0){
+        for(int r = 0; r <= nthreads; ++r)
+            displs[r] /= sizeof(TraceEvent);
+        if(!writeTrace(tracePath, all, displs, nthreads))
+            printf("Warning: cannot write trace %s!\n", tracePath);
+        free(all);
+        free(counts);
+        free(displs);
+    }
+}
 
 
 int init_allegro(){
@@ -170,245 +1453,592 @@ int init_allegro(){
         return -1;
     }
 
-    display = al_create_display(COLS*SIZE_CELL, ROWS*SIZE_CELL);
+    display = al_create_display(windowWidth, windowHeight);
+    if(!display){
+        printf("Error: failed to create a %dx%d display!\n", windowWidth, windowHeight);
+        return -1;
+    }
     queue = al_create_event_queue();
-
-    al_init_primitives_addon();
-
+    renderer = new FrameRenderer(ROWS, COLS, windowWidth, windowHeight);
+    if(!renderer->valid()){
+        printf("Error: failed to create the frame bitmap!\n");
+        return -1;
+    }
+    if(!viewGather)
+        viewImage = (cell_t*) malloc((size_t)windowWidth*windowHeight*sizeof(cell_t));
+
+    // Mouse e tastiera muovono il viewport
+    al_install_mouse();
+    al_install_keyboard();
+    al_register_event_source(queue, al_get_mouse_event_source());
+    al_register_event_source(queue, al_get_keyboard_event_source());
     al_register_event_source(queue, al_get_display_event_source(display));
 	al_set_window_title(display, TITLE);
     return 0;
 }
 
-void print(){
-    al_clear_to_color(al_map_rgb(0, 0, 0));
-    for(int y = 0; y < ROWS; ++y){
-        for(int x = 0; x < COLS; ++x){
-            switch (matrix[coords(y,x)])
-            {
-                case EMPTY:
-                    al_draw_filled_rectangle(x * (SIZE_CELL), y * (SIZE_CELL), x * (SIZE_CELL) + SIZE_CELL, y * (SIZE_CELL) + SIZE_CELL, al_map_rgb(0,0,0));  
-                    break;
-                
-                case SEEDED_GRASS: 
-                    al_draw_filled_rectangle(x * (SIZE_CELL), y * (SIZE_CELL), x * (SIZE_CELL) + SIZE_CELL, y * (SIZE_CELL) + SIZE_CELL, al_map_rgb(34,139,34));   
-                    break;
-                
-                case GROWING_GRASS: 
-                    al_draw_filled_rectangle(x * (SIZE_CELL), y * (SIZE_CELL), x * (SIZE_CELL) + SIZE_CELL, y * (SIZE_CELL) + SIZE_CELL, al_map_rgb(50,205,50));
-                    break;
-                
-                case GROWN_GRASS: 
-                    al_draw_filled_rectangle(x * (SIZE_CELL), y * (SIZE_CELL), x * (SIZE_CELL) + SIZE_CELL, y * (SIZE_CELL) + SIZE_CELL, al_map_rgb(0,255,0));  
-                    break;
-                
-                case PARASITE: 
-                    al_draw_filled_rectangle(x * (SIZE_CELL), y * (SIZE_CELL), x * (SIZE_CELL) + SIZE_CELL, y * (SIZE_CELL) + SIZE_CELL, al_map_rgb(255,0,0));  
-                    break;
-
-                default: break;
-            }
+// Ciclo del thread di disegno: inizializza Allegro (comunicando l'esito al thread principale),
+// poi disegna ogni generazione nuova e controlla gli eventi della finestra almeno 60 volte al
+// secondo, finché il ciclo principale non chiude l'anello delle istantanee
+void renderLoop(std::promise<int> *started){
+    int result = init_allegro();
+    started->set_value(result);
+    if(result == -1)
+        return;
+
+    while(!frames->closed()){
+        int gen;
+        Viewport frameView;
+        const cell_t *frame = frames->take(&gen, &frameView, 1.0 / 60.0);
+        if(frame)
+            print(frame, frameView);
+
+        ALLEGRO_EVENT event;
+        while(al_get_next_event(queue, &event)){
+            if(event.type == ALLEGRO_EVENT_DISPLAY_CLOSE)
+                windowClosed = true;
+            else
+                handleViewEvent(event);
         }
     }
+    finalize_allegro();
+}
+
+// Spostamento e ingrandimento del viewport: trascinamento e rotella del mouse (intorno al puntatore),
+// frecce (un quarto della finestra), +/- (intorno al centro) e Home (intera griglia). Il nuovo
+// viewport viene usato dal gather dopo il messaggio di controllo successivo
+void handleViewEvent(const ALLEGRO_EVENT &event){
+    Viewport v = shownView;
+    double cellsPerPixel = (double)v.cols / windowWidth > (double)v.rows / windowHeight ?
+                           (double)v.cols / windowWidth : (double)v.rows / windowHeight;
+
+    switch(event.type){
+        case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN: dragging = true; return;
+        case ALLEGRO_EVENT_MOUSE_BUTTON_UP: dragging = false; return;
+
+        case ALLEGRO_EVENT_MOUSE_AXES:
+            if(event.mouse.dz != 0)
+                v = zoomView(v, pow(0.5, event.mouse.dz), event.mouse.x, event.mouse.y, ROWS, COLS, windowWidth, windowHeight);
+            else if(dragging)
+                v = panView(v, (int)lround(-event.mouse.dy * cellsPerPixel), (int)lround(-event.mouse.dx * cellsPerPixel),
+                            ROWS, COLS, windowWidth, windowHeight);
+            else return;
+            break;
+
+        case ALLEGRO_EVENT_KEY_DOWN:
+            switch(event.keyboard.keycode){
+                case ALLEGRO_KEY_UP: v = panView(v, -v.rows/4, 0, ROWS, COLS, windowWidth, windowHeight); break;
+                case ALLEGRO_KEY_DOWN: v = panView(v, v.rows/4, 0, ROWS, COLS, windowWidth, windowHeight); break;
+                case ALLEGRO_KEY_LEFT: v = panView(v, 0, -v.cols/4, ROWS, COLS, windowWidth, windowHeight); break;
+                case ALLEGRO_KEY_RIGHT: v = panView(v, 0, v.cols/4, ROWS, COLS, windowWidth, windowHeight); break;
+                case ALLEGRO_KEY_EQUALS:
+                case ALLEGRO_KEY_PAD_PLUS: v = zoomView(v, 0.5, windowWidth/2, windowHeight/2, ROWS, COLS, windowWidth, windowHeight); break;
+                case ALLEGRO_KEY_MINUS:
+                case ALLEGRO_KEY_PAD_MINUS: v = zoomView(v, 2, windowWidth/2, windowHeight/2, ROWS, COLS, windowWidth, windowHeight); break;
+                case ALLEGRO_KEY_HOME: v = fullView(ROWS, COLS, windowWidth, windowHeight); break;
+                default: return;
+            }
+            break;
+
+        default: return;
+    }
+
+    shownView = v;
+    std::lock_guard<std::mutex> guard(viewLock);
+    requestedView = v;
+}
+
+// Disegno di una generazione: l'immagine ridotta del viewport raccolta dai processi, oppure (con la
+// griglia intera) la riduzione del viewport scelto, fatta qui
+void print(const cell_t *frame, const Viewport &frameView){
+    if(viewGather)
+        renderer->drawView(frame, viewRows(frameView), viewCols(frameView));
+    else{
+        int span[4];
+        reduceZone(frame, COLS, 0, 0, ROWS, COLS, shownView, viewImage, span);
+        renderer->drawView(viewImage, viewRows(shownView), viewCols(shownView));
+    }
     al_flip_display();
-    al_rest(1.0 / 60.0);
+    al_rest(1.0 / 60.0);    // limita a 60 frame al secondo il solo thread di disegno
 }
 
 void finalize_allegro(){
 
+    delete renderer;
+    renderer = 0;
+    free(viewImage);
+    viewImage = 0;
     al_destroy_event_queue(queue);
     al_destroy_display(display);
     queue = 0;
     display = 0;
 }
 
-// Viene eseguita la funzione di transizione sulle celle che non hanno bordi come vicini
+// Viene eseguita la funzione di transizione sulle celle che non hanno bordi come vicini,
+// divise tra i thread per tile; la zona interna dei tile non attivi non viene calcolata.
+// Tra un tile e l'altro il thread principale fa avanzare lo scambio dei bordi già avviato
 void transFunctionInside(){
-    int start_index = 2, end_index = (ROWS/nthreads)-1;
+    auto tile = [](int t, int thread){
+        if(!tileActive[t])
+            return;
+
+        int ty = t / tilesX, tx = t % tilesX;
+        int top = ty*tileRows + 1 > insideTop ? ty*tileRows + 1 : insideTop;
+        int bottom = (ty+1)*tileRows < insideBottom ? (ty+1)*tileRows : insideBottom;
+        int left = tx*tileCols + 1 > insideLeft ? tx*tileCols + 1 : insideLeft;
+        int right = (tx+1)*tileCols < insideRight ? (tx+1)*tileCols : insideRight;
+
+        for(int i = top; i <= bottom; ++i)
+            transFunction(i, left, right - left + 1, thread);
+    };
+    auto progress = []{
+        int flag;
+        MPI_Testall(16, haloRequests, &flag, MPI_STATUSES_IGNORE);
+        MPI_Test(&gatherRequest, &flag, MPI_STATUS_IGNORE);
+        MPI_Test(&controlRequest, &flag, MPI_STATUS_IGNORE);
+        MPI_Test(&checkpointRequest, &flag, MPI_STATUS_IGNORE);
+    };
+    pool->run(tilesY*tilesX, tile, progress);
+}
 
-    if(rank == 0)
-        start_index--;
-    if(rank == (nthreads-1))
-        end_index++;
+// Un tile è attivo se in esso o nei tile adiacenti c'è un parassita oppure qualche cella è
+// cambiata in una delle ultime due generazioni. Altrimenti, senza parassiti le regole sono
+// deterministiche e l'intorno del tile è uguale a due generazioni fa, quando la regola (con la stessa
+// parità di GEN) non ha cambiato nulla: la nuova generazione del tile è uguale a quella attuale.
+// Il buffer di scrittura contiene la generazione precedente, anch'essa uguale, quindi il tile
+// non va né calcolato né copiato.
+// Dopo la scelta, lo stato dei tile viene fatto avanzare di una generazione
+void markActiveTiles(){
+    for(int ty = 0; ty < tilesY; ++ty){
+        for(int tx = 0; tx < tilesX; ++tx){
+            uint8_t near = 0;
+            for(int y = ty-1; y <= ty+1; ++y)
+                for(int x = tx-1; x <= tx+1; ++x)
+                    if(y >= 0 && y < tilesY && x >= 0 && x < tilesX)
+                        near |= tileState[y*tilesX + x];
+
+            tileActive[ty*tilesX + tx] = denseTiles || near != 0;
+            activeTiles += tileActive[ty*tilesX + tx];
+        }
+    }
+    totalTiles += tilesY*tilesX;
+
+    for(int t = 0; t < tilesY*tilesX; ++t)
+        tileState[t] = (tileState[t] & TILE_CHANGED) ? TILE_CHANGED_BEFORE : 0;
+}
 
-    for(int i = start_index; i <= end_index; ++i)
-        for(int j = 0; j < COLS; ++j)
-            transFunction(i, j);
+// Aggiorna lo stato dei tile toccati dalle n celle della riga r (a partire dalla colonna c)
+// appena calcolate; le celle della cornice non appartengono a nessun tile. Lo stesso tile può
+// essere aggiornato da più thread, quindi i bit vengono aggiunti con un'operazione atomica
+void trackTiles(int r, int c, int n){
+    if(denseTiles || r < 1 || r > localRows)
+        return;
+
+    int first = c > 1 ? c : 1, last = c+n-1 < localCols ? c+n-1 : localCols;
+    uint8_t *row = tileState + (size_t)((r-1)/tileRows)*tilesX;
+
+    for(int b = first; b <= last; ){
+        int tx = (b-1)/tileCols;
+        int e = (tx+1)*tileCols < last ? (tx+1)*tileCols : last;
+        uint8_t bits = 0;
+
+        if(memcmp(localReadMatrix + coords(r,b), localWriteMatrix + coords(r,b), e-b+1) != 0)
+            bits |= TILE_CHANGED;
+        if(memchr(localWriteMatrix + coords(r,b), PARASITE, e-b+1) != NULL)
+            bits |= TILE_PARASITE;
+        if((__atomic_load_n(&row[tx], __ATOMIC_RELAXED) & bits) != bits)
+            __atomic_fetch_or(&row[tx], bits, __ATOMIC_RELAXED);
+        b = e+1;
+    }
 }
 
 // Viene eseguita la funzione di transizione sulle celle aventi i bordi come vicini,
-// dopo aver ricevuto i bordi dagli altri processi 
+// dopo aver ricevuto i bordi dagli altri processi: le righe fuori dalla zona interna
+// per intero, le altre solo nelle colonne ai lati della zona interna.
+// Con haloDepth > 1 si calcola anche una parte della cornice, larghezza haloDepth-1 dopo lo scambio
+// e poi una cella in meno ad ogni generazione, solo sui lati che hanno un vicino (altrove la
+// cornice resta EMPTY): così alla generazione successiva le celle lette sono ancora valide
 void transFunctionBorders(){
-
-    int start_index = 1, end_index = (ROWS/nthreads);
-
-    for(int j = 0; j < COLS; ++j){
-        if(rank != 0)
-            transFunction(1, j);
-
-        if(rank != (nthreads-1))
-            transFunction(ROWS/nthreads, j);
-        }      
+    int extra = haloDepth - 1 - haloPhase;
+
+    static int top, bottom, left, right;
+    top = neighbors[NORTH] == MPI_PROC_NULL ? 1 : 1-extra;
+    bottom = neighbors[SOUTH] == MPI_PROC_NULL ? localRows : localRows+extra;
+    left = neighbors[WEST] == MPI_PROC_NULL ? 1 : 1-extra;
+    right = neighbors[EAST] == MPI_PROC_NULL ? localCols : localCols+extra;
+
+    auto tile = [](int t, int thread){
+        int last = top + (t+1)*tileRows - 1 < bottom ? top + (t+1)*tileRows - 1 : bottom;
+        for(int i = top + t*tileRows; i <= last; ++i){
+            if(i < insideTop || i > insideBottom)
+                transFunction(i, left, right - left + 1, thread);
+            else{
+                transFunction(i, left, insideLeft - left, thread);
+                transFunction(i, insideRight + 1, right - insideRight, thread);
+            }
+        }
+    };
+    pool->run((bottom - top + 1 + tileRows - 1) / tileRows, tile);
 }
 
-void transFunction(int r, int c){
-    int numParasiteCells = 0, numGrassCells = 0, numEmptyCells = 0, randNum;
-    bool parasiteFound = false;
-
-    if(GEN % 2 == 0) { // Eseguo la funzione di transizione solo sulle celle GRASS e EMPTY
-        if(localReadMatrix[coords(r,c)] == GROWN_GRASS)
-            localWriteMatrix[coords(r,c)] = GROWN_GRASS;
-
-        else if(localReadMatrix[coords(r,c)] == GROWING_GRASS) // GROWING_GRASS -> GROWN_GRASS
-            localWriteMatrix[coords(r,c)] = GROWN_GRASS;
-
-        else if(localReadMatrix[coords(r,c)] == SEEDED_GRASS) // SEEDED_GRASS -> GROWING_GRASS
-            localWriteMatrix[coords(r,c)] = GROWING_GRASS;
-
-        else if(localReadMatrix[coords(r,c)] == PARASITE)
-            localWriteMatrix[coords(r,c)] = PARASITE;   
+// Passata del blocking temporale: steps generazioni, divise tra i thread per strisce di colonne.
+// La generazione k della passata calcola il blocco e, sui lati con un vicino, extra-k livelli
+// della cornice, dove extra sono i livelli ancora validi (come in transFunctionBorders)
+void fusedPass(int steps){
+    static FusedPlan plan;
+    int extra = haloDepth - haloPhase;
+
+    plan.steps = steps;
+    for(int k = 1; k <= steps; ++k){
+        plan.region[k].top = neighbors[NORTH] == MPI_PROC_NULL ? 1 : 1-(extra-k);
+        plan.region[k].bottom = neighbors[SOUTH] == MPI_PROC_NULL ? localRows : localRows+(extra-k);
+        plan.region[k].left = neighbors[WEST] == MPI_PROC_NULL ? 1 : 1-(extra-k);
+        plan.region[k].right = neighbors[EAST] == MPI_PROC_NULL ? localCols : localCols+(extra-k);
+    }
+    plan.stride = stride;
+    plan.colOrigin = haloDepth - 1;
+    plan.gen = GEN;
+    plan.rowOffset = rowOffset - 1;
+    plan.colOffset = colOffset - 1;
+    plan.seed = seed;
+    plan.rows = torus ? ROWS : 0;
+    plan.cols = torus ? COLS : 0;
+    plan.count = (FusedRegion){1, localRows, 1, localCols};
+
+    const FusedRegion &last = plan.region[steps];
+    auto strip = [](int t, int thread){
+        const FusedRegion &last = plan.region[plan.steps];
+        int left = last.left + t*stripWidth;
+        int right = left + stripWidth - 1 < last.right ? left + stripWidth - 1 : last.right;
+        fusedStrip(transRow, localReadMatrix + coords(0,0), localWriteMatrix + coords(0,0), plan, left, right, fusedScratch[thread]);
+    };
+    pool->run((last.right - last.left + 1 + stripWidth - 1) / stripWidth, strip);
+}
 
-            // ------------------------------------------------------
-            // Se una cella EMPTY ha 3 o più vicini GROWN_GRASS,
-            // allora diventa GRASS (SEEDED, perchè appena seminato);
-            // altrimenti, rimane EMPTY
+// Applica il kernel alle n celle della riga r a partire dalla colonna c. Il kernel legge anche
+// le colonne c-1 e c+n e le righe r-1 e r+1: ai bordi della griglia la cornice non viene
+// mai ricevuta e resta EMPTY, che non conta né come GROWN_GRASS né come PARASITE (con --torus
+// viene invece dal lato opposto, e le celle fuori dalla griglia usano i numeri casuali di quel lato)
+void transFunction(int r, int c, int n, int thread){
+    if(n <= 0)
+        return;
+
+    RowContext ctx = {GEN, rowOffset + r-1, colOffset + c-1, seed, torus ? ROWS : 0, torus ? COLS : 0};
+
+    // Si contano solo le transizioni delle celle locali, non quelle della cornice
+    RowScratch &s = scratch[thread];
+    bool local = r >= 1 && r <= localRows;
+    s.countFrom = local ? 1-c : 0;
+    s.countTo = local ? localCols+1-c : 0;
+
+    periodicRow(transRow, localReadMatrix + coords(r-1,c), localReadMatrix + coords(r,c), localReadMatrix + coords(r+1,c),
+                localWriteMatrix + coords(r,c), n, ctx, s);
+    trackTiles(r, c, n);
+}
 
-        else {
-            for (int i = -1; i <= 1; ++i)
-                for (int j = -1; j <= 1; ++j)
-                    if(!((r+i) == 0 && rank == 0) && !((r+i) == (ROWS/nthreads+1) && rank == (nthreads-1)) && (c+j) < COLS && (c+j) >= 0)
-                        if(localReadMatrix[coords(r+i,c+j)] == GROWN_GRASS)
-                            numGrassCells++;
+// Azzeramento delle matrici locali con la stessa divisione in tile (e quindi, salvo furti,
+// con gli stessi thread) della funzione di transizione
+void firstTouch(){
+    auto tile = [](int t, int thread){
+        int rows = localRows + 2*haloDepth;
+        int last = (t+1)*tileRows < rows ? (t+1)*tileRows : rows;
+        size_t bytes = (size_t)(last - t*tileRows)*stride*sizeof(cell_t);
+        memset(localReadMatrix + (size_t)t*tileRows*stride, 0, bytes);
+        memset(localWriteMatrix + (size_t)t*tileRows*stride, 0, bytes);
+    };
+    pool->run((localRows + 2*haloDepth + tileRows - 1) / tileRows, tile);
+}
 
-            if(numGrassCells >= 3)
-                localWriteMatrix[coords(r,c)] = SEEDED_GRASS;
-                
-            else localWriteMatrix[coords(r,c)] = EMPTY;
-        }
+// Creazione delle richieste persistenti dei bordi per entrambi i buffer: ricezioni nella cornice
+// e invii dei bordi agli 8 vicini (righe, colonne e angoli); con MPI_PROC_NULL le operazioni non
+// fanno nulla. Il tag è la direzione di invio, quindi chi riceve dalla direzione d si aspetta il
+// tag opposite[d]
+void initHaloPlan(){
+    haloBuffer[0] = localReadMatrix;
+    haloBuffer[1] = localWriteMatrix;
+
+    // I bordi verso il processo stesso (--torus con una sola riga o colonna di processi) vengono
+    // copiati da copySelfBorders(): le loro richieste non fanno nulla. Con --shared-halo i vicini
+    // sullo stesso nodo si inviano solo un messaggio vuoto e la cornice viene copiata da copySharedBorders()
+    int peers[8], count[8];
+    bool shared[8];
+    for(int d = 0; d < 8; ++d){
+        peers[d] = neighbors[d] == rank ? MPI_PROC_NULL : neighbors[d];
+        shared[d] = sharedHalo && peers[d] != MPI_PROC_NULL && nodeRanks[peers[d]] != MPI_UNDEFINED;
+        count[d] = shared[d] ? 0 : 1;
     }
 
-    else { // Eseguo la funzione di transizione solo sui predatori (PARASITE)
-
-            // -------------------------------------------------------------------------
-            // Se una cella GROWN_GRASS (preda) ha almeno un vicino PARASITE (predatore)
-            // e se il numero casuale è compreso tra 1 e 5,
-            // allora la cella GROWN_GRASS diventa un PARASITE;
-            // altrimenti, rimane GROWN_GRASS
+    for(int b = 0; b < 2; ++b){
+        for(int d = 0; d < 8; ++d)
+            MPI_Recv_init(haloBuffer[b] + recvOffset[d], count[d], haloType[d], peers[d], opposite[d], comm, &haloPlan[b][d]);
+        for(int d = 0; d < 8; ++d)
+            MPI_Send_init(haloBuffer[b] + sendOffset[d], count[d], haloType[d], peers[d], d, comm, &haloPlan[b][8+d]);
+    }
 
-        if(localReadMatrix[coords(r,c)] == GROWN_GRASS) {
-            for (int i = -1; i <= 1; ++i) {
-                for (int j = -1; j <= 1; ++j) {
-                    if(!((r+i) == 0 && rank == 0) && !((r+i) == ((ROWS/nthreads)+1) && rank == (nthreads-1)) && (c+j) < COLS && (c+j) >= 0 && localReadMatrix[coords(r+i,c+j)] == PARASITE) { 
-                        parasiteFound = true;
-                        randNum = (rand() % 20) + 1; // Numero casuale, compreso tra 1 e 20
-                    }
-                }
+    haloPlanMessages = haloPlanBytes = sharedPlanBytes = 0;
+    for(int d = 0; d < 8; ++d){
+        if(peers[d] != MPI_PROC_NULL){
+            int bytes;
+            MPI_Type_size(haloType[d], &bytes);
+            if(shared[d])
+                sharedPlanBytes += bytes;
+            else{
+                haloPlanMessages++;
+                haloPlanBytes += bytes;
             }
-                
-            if(parasiteFound && randNum <= 5) 
-                localWriteMatrix[coords(r,c)] = PARASITE;
-
-            else localWriteMatrix[coords(r,c)] = GROWN_GRASS;
         }
+    }
 
-        else if(localReadMatrix[coords(r,c)] == GROWING_GRASS)
-            localWriteMatrix[coords(r,c)] = GROWING_GRASS;
-
-        else if(localReadMatrix[coords(r,c)] == SEEDED_GRASS)
-            localWriteMatrix[coords(r,c)] = SEEDED_GRASS;
-            
-            // --------------------------------------------------------------------
-            // Se una cella PARASITE ha 5 o più vicini PARASITE (sovrappopolazione)
-            // oppure non ha alcun vicino GROWN_GRASS
-            // oppure abbiamo superato la 50-esima iterazione (GEN > 50)
-            // e il numero casuale è compreso tra 1 e 5,
-            // allora muore, cioè diventa EMPTY;
-            // altrimenti, rimane PARASITE
-
-        else if(localReadMatrix[coords(r,c)] == PARASITE) {
-            for (int i = -1; i <= 1; ++i) {
-                for (int j = -1; j <= 1; ++j) {
-                    if(!((r+i) == 0 && rank == 0) && !((r+i) == (ROWS/nthreads+1) && rank == (nthreads-1)) && (c+j) < COLS && (c+j) >= 0) {
-                        if(localReadMatrix[coords(r+i,c+j)] == PARASITE)
-                            numParasiteCells++;
-
-                        else if(localReadMatrix[coords(r+i,c+j)] == GROWN_GRASS)
-                            numGrassCells++;
-                        }
-                    }
-                }
-                
-            randNum = (rand() % 20) + 1; // Numero casuale, compreso tra 1 e 20
-
-            if(numParasiteCells >= 5 || numGrassCells == 0)
-                localWriteMatrix[coords(r,c)] = EMPTY;
-            
-            else if(GEN > 50 && randNum <= 5) 
-                localWriteMatrix[coords(r,c)] = EMPTY;
-
-            else localWriteMatrix[coords(r,c)] = PARASITE;      
+    if(!sharedHalo)
+        return;
+
+    // Bordo che il vicino sullo stesso nodo invia verso questo processo (direzione opposta), nel suo
+    // blocco: le dimensioni vengono dalle sue coordinate, il buffer dalla finestra condivisa
+    for(int d = 0; d < 8; ++d){
+        int c[2], offset, rows, cols;
+        sharedSource[0][d] = sharedSource[1][d] = NULL;
+        if(!shared[d])
+            continue;
+
+        MPI_Cart_coords(comm, peers[d], 2, c);
+        rowRange(c[0], &offset, &rows);
+        blockRange(COLS, dims[1], c[1], &offset, &cols);
+        sharedStride[d] = cols + 2*haloDepth;
+        for(int b = 0; b < 2; ++b){
+            MPI_Aint size;
+            int unit;
+            cell_t *base;
+            MPI_Win_shared_query(matrixWindow[b], nodeRanks[peers[d]], &size, &unit, &base);
+            sharedSource[b][d] = base + borderOffset(opposite[d], rows, cols, true);
         }
+    }
 
-        else localWriteMatrix[coords(r,c)] = EMPTY;
-    }   
+    for(int d = 0; d < 8; ++d){
+        int peer = shared[d] ? peers[d] : MPI_PROC_NULL;
+        MPI_Recv_init(NULL, 0, MPI_CELL, peer, 8+opposite[d], comm, &sharedRelease[d]);
+        MPI_Send_init(NULL, 0, MPI_CELL, peer, 8+d, comm, &sharedRelease[8+d]);
+    }
+}
+
+void freeHaloPlan(){
+    for(int b = 0; b < 2; ++b)
+        for(int i = 0; i < 16; ++i)
+            MPI_Request_free(&haloPlan[b][i]);
+    if(sharedHalo)
+        for(int i = 0; i < 16; ++i)
+            MPI_Request_free(&sharedRelease[i]);
 }
 
-// invio bordi NON BLOCCANTE (asincrono)
+// invio bordi NON BLOCCANTE (asincrono): si avvia il piano del buffer letto in questa generazione
 void MPI_sendBorders(){
-    
-    MPI_Request req;
+    int b = localReadMatrix == haloBuffer[0] ? 0 : 1;
+    haloRequests = haloPlan[b];
+    // il messaggio vuoto ai vicini sullo stesso nodo rende visibile il buffer appena calcolato
+    if(sharedHalo)
+        MPI_Win_sync(matrixWindow[b]);
+    MPI_Startall(16, haloRequests);
+    copySelfBorders();
+
+    haloMessages += haloPlanMessages;
+    haloBytes += haloPlanBytes;
+}
 
-    int sendingUp = 0, sendingDown = 1;
+// Con --torus, copia dei bordi il cui vicino è il processo stesso: il bordo inviato nella
+// direzione d è la cornice ricevuta dalla direzione opposta
+void copySelfBorders(){
+    for(int d = 0; d < 8; ++d){
+        if(neighbors[d] != rank)
+            continue;
+        const cell_t *from = localReadMatrix + sendOffset[d];
+        cell_t *to = localReadMatrix + recvOffset[opposite[d]];
+        for(int r = 0; r < haloRows[d]; ++r)
+            memcpy(to + (size_t)r*stride, from + (size_t)r*stride, haloCols[d]*sizeof(cell_t));
+    }
+}
 
-    // Il processo con rank 0 invia solo al suo vicino sud 
-    if(rank == 0)
-        MPI_Isend(localReadMatrix+coords((ROWS/nthreads),0), 1, borderType, downNeighbor, sendingDown, comm, &req);
+// Attesa della ricezione dei bordi (e del completamento degli invii, prima che swap() riusi il buffer)
+void MPI_recvBorders(){
+    MPI_Waitall(16, haloRequests, MPI_STATUSES_IGNORE);
+    if(sharedHalo)
+        copySharedBorders();
+}
 
-    // Il processo con rank nthreads-1 invia solo al suo vicino nord
-    else if(rank == nthreads-1)
-        MPI_Isend(localReadMatrix+coords(1,0), 1, borderType, upNeighbor, sendingUp, comm, &req);
+// Con --shared-halo, copia della cornice dai blocchi dei vicini sullo stesso nodo, che hanno già
+// segnalato (con il messaggio vuoto dello scambio) di aver calcolato il buffer letto in questa
+// generazione. Se prima del prossimo scambio i vicini riscriveranno quel buffer, si aspetta
+// che tutti abbiano finito di copiare
+void copySharedBorders(){
+    int b = haloRequests == haloPlan[0] ? 0 : 1;
+    MPI_Win_sync(matrixWindow[b]);
+
+    for(int d = 0; d < 8; ++d){
+        const cell_t *from = sharedSource[b][d];
+        if(from == NULL)
+            continue;
+        cell_t *to = localReadMatrix + recvOffset[d];
+        for(int r = 0; r < haloRows[d]; ++r)
+            memcpy(to + (size_t)r*stride, from + (size_t)r*sharedStride[d], haloCols[d]*sizeof(cell_t));
+    }
+    sharedBytes += sharedPlanBytes;
 
-    else{
-        MPI_Isend(localReadMatrix+coords(1,0), 1, borderType, upNeighbor, sendingUp, comm, &req);
-        MPI_Isend(localReadMatrix+coords((ROWS/nthreads),0), 1, borderType, downNeighbor, sendingDown, comm, &req);
+    if(sharedReleaseNeeded){
+        MPI_Startall(16, sharedRelease);
+        MPI_Waitall(16, sharedRelease, MPI_STATUSES_IGNORE);
     }
 }
 
-void MPI_recvBorders(){
-    
-    MPI_Status status;
+// Il processo 0 scrive lo stato di controllo (chiusura della finestra) e lo invia a tutti
+void startControl(){
+    if(rank == 0){
+        control[CONTROL_END] = !headless && windowClosed;
+        std::lock_guard<std::mutex> guard(viewLock);
+        control[CONTROL_VIEW_TOP] = requestedView.top;
+        control[CONTROL_VIEW_LEFT] = requestedView.left;
+        control[CONTROL_VIEW_ROWS] = requestedView.rows;
+        control[CONTROL_VIEW_COLS] = requestedView.cols;
+        control[CONTROL_VIEW_SCALE] = requestedView.scale;
+    }
+    MPI_Ibcast(control, CONTROL_COUNT, MPI_INT, 0, comm, &controlRequest);
+    controlPending = true;
+}
 
-    int receivingFromDown = 0, receivingFromUp = 1;
+// Attesa del messaggio di controllo in corso (se c'è) e applicazione dello stato ricevuto
+void completeControl(){
+    if(!controlPending)
+        return;
+
+    MPI_Wait(&controlRequest, MPI_STATUS_IGNORE);
+    controlPending = false;
+    end = control[CONTROL_END];
+    view.top = control[CONTROL_VIEW_TOP];
+    view.left = control[CONTROL_VIEW_LEFT];
+    view.rows = control[CONTROL_VIEW_ROWS];
+    view.cols = control[CONTROL_VIEW_COLS];
+    view.scale = control[CONTROL_VIEW_SCALE];
+}
 
-    // Il processo con rank 0 riceve solo dal suo vicino sud 
-    if(rank == 0)
-        MPI_Recv(localReadMatrix+coords((ROWS/nthreads)+1,0), 1, borderType, downNeighbor, receivingFromDown, comm, &status);
+// Scambio dei due buffer persistenti: nessuna allocazione né azzeramento ad ogni generazione.
+// Non serve azzerare il buffer di scrittura perché la funzione di transizione riscrive tutte
+// le celle locali (tranne quelle dei tile non attivi, già uguali), mentre le righe di bordo
+// vengono sovrascritte dalla ricezione
+void swap(){
+    cell_t* tmp = localReadMatrix;
+    localReadMatrix = localWriteMatrix;
+    localWriteMatrix = tmp;
+}
 
-    // Il processo con rank nthreads-1 riceve solo dal suo vicino nord 
-    else if(rank == nthreads-1)
-        MPI_Recv(localReadMatrix+coords(0,0), 1, borderType, upNeighbor, receivingFromUp, comm, &status);
+// Allocazione allineata alla pagina (o a 2MB con --hugepages, chiedendo al kernel le huge pages).
+// La memoria viene azzerata qui (salvo zero = false, se ci pensa firstTouch()),
+// quindi il primo accesso avviene comunque fuori dal ciclo principale
+cell_t* allocMatrix(size_t cells, bool zero){
+    size_t alignment = hugePages ? (2 << 20) : 4096;
+    size_t bytes = (cells * sizeof(cell_t) + alignment - 1) / alignment * alignment;
+    void* m = NULL;
+
+    if(posix_memalign(&m, alignment, bytes) != 0){
+        printf("Error: failed to allocate %zu bytes!\n", bytes);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+#ifdef MADV_HUGEPAGE
+    if(hugePages)
+        madvise(m, bytes, MADV_HUGEPAGE);
+#endif
+    if(zero)
+        memset(m, 0, bytes);
+    allocations++;
+    return (cell_t*) m;
+}
 
+void freeMatrix(cell_t* m){
+    free(m);
+}
+
+// Allocazione dei due buffer del blocco locale, che vengono azzerati dai thread che li useranno
+// (first touch): così su macchine NUMA ogni pagina finisce nella memoria vicina al core che la
+// elabora. Con --shared-halo ogni buffer è il segmento di questo processo in una finestra condivisa
+// del nodo (non contiguo, così anche i segmenti seguono il first touch); le finestre restano in
+// un'epoca passiva per tutta la loro vita e la visibilità degli aggiornamenti è data da MPI_Win_sync
+void allocLocalMatrices(){
+    size_t cells = (size_t)(localRows+2*haloDepth)*stride;
+
+    if(sharedHalo){
+        MPI_Info info;
+        MPI_Info_create(&info);
+        MPI_Info_set(info, "alloc_shared_noncontig", "true");
+        cell_t *m[2];
+        for(int b = 0; b < 2; ++b){
+            MPI_Win_allocate_shared(cells*sizeof(cell_t), sizeof(cell_t), info, nodeComm, &m[b], &matrixWindow[b]);
+            MPI_Win_lock_all(MPI_MODE_NOCHECK, matrixWindow[b]);
+            allocations++;
+        }
+        MPI_Info_free(&info);
+        localReadMatrix = m[0];
+        localWriteMatrix = m[1];
+    }
     else{
-        MPI_Recv(localReadMatrix+coords(0,0), 1, borderType, upNeighbor, receivingFromUp, comm, &status);
-        MPI_Recv(localReadMatrix+coords((ROWS/nthreads)+1,0), 1, borderType, downNeighbor, receivingFromDown, comm, &status);
+        localReadMatrix = allocMatrix(cells, false);
+        localWriteMatrix = allocMatrix(cells, false);
     }
+    firstTouch();
 }
 
-void swap(){
-    free(localReadMatrix);
-    localReadMatrix = localWriteMatrix;
-    localWriteMatrix = (int*) calloc((ROWS/nthreads+2)*COLS,sizeof(int));
+void freeLocalMatrices(){
+    if(sharedHalo){
+        for(int b = 0; b < 2; ++b){
+            MPI_Win_unlock_all(matrixWindow[b]);
+            MPI_Win_free(&matrixWindow[b]);
+        }
+    }
+    else{
+        freeMatrix(localWriteMatrix);
+        freeMatrix(localReadMatrix);
+    }
 }
 
 
 void finalize(){
     if(rank == 0){
-        finalize_allegro();
-        free(matrix);
+        if(!headless){
+            frames->close();
+            renderThread.join();
+            delete frames;
+            frames = 0;
+        }
+        recorder.close();
+        stats.close();
+        freeMatrix(matrix);
+        freeMatrix(gatherBuffer);
+        free(gatherCounts);
+        free(gatherDispls);
+        free(viewSpans);
         matrix = 0;
     }
     
-    free(localWriteMatrix);
-    free(localReadMatrix);
+    freeLayout();
+    freeLocalMatrices();
+    if(viewGather)
+        freeMatrix(viewBuffer);
+    for(int t = 0; t < threadCount; ++t)
+        freeMatrix(scratch[t].mem);
+    free(scratch);
+    free(rowStarts);
+    MPI_Comm_free(&colComm);
+    if(sharedHalo){
+        free(nodeRanks);
+        MPI_Comm_free(&nodeComm);
+    }
+    if(fuseSteps > 1){
+        for(int t = 0; t < threadCount; ++t)
+            freeMatrix(fusedScratch[t].rows);
+        free(fusedScratch);
+    }
+    if(statsPath){
+        free(threadCounts);
+        free(statsBuffer);
+        free(statsGens);
+    }
+
+    delete pool;
+    pool = 0;
     localReadMatrix = localWriteMatrix = 0;
 }
\ No newline at end of file
@@ -0,0 +1,356 @@
+// Versione "ensemble": molte simulazioni indipendenti di griglie piccole in un solo processo,
+// per studiare con seed e soglie diversi se l'equilibrio tra prede e predatori regge.
+//
+// Le repliche sono divise tra i processi MPI (blocchi che differiscono al più di una replica) e
+// ogni processo le raggruppa in pacchetti da 64: lo stato di una cella in 64 repliche occupa 3 parole
+// da 64 bit e ogni operazione logica aggiorna 64 simulazioni insieme (ensemble.h). I processi non
+// comunicano durante il calcolo, solo per raccogliere le statistiche.
+//
+// La replica i usa il seed --seed + i e la combinazione (i modulo il numero di combinazioni) delle
+// liste --seed-min, --crowding, --infection-odds e --late-death-odds (i parametri di ParasiteRules),
+// quindi con le soglie predefinite la replica i è identica alla versione seriale con --seed S+i.
+//
+// Compile and run:
+//  > mpicxx -O2 parasites_ensemble.cpp -o parasites_ensemble
+//  > mpirun -np 4 ./parasites_ensemble --rows 64 --steps 2000 --replicas 1024 --seed 1
+//  > mpirun -np 8 ./parasites_ensemble --replicas 4096 --crowding 4,5,6 --infection-odds 3,5,7 --stats sweep.csv
+//
+// Con --stats FILE il processo 0 scrive in un solo CSV, ogni --stats-every N generazioni, la
+// popolazione di ogni stato in ogni replica, con i suoi parametri e la generazione in cui i
+// parassiti si sono estinti (-1 se ci sono ancora). Al termine il processo 0 stampa una riga BENCH.
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "mpi.h"
+#include "kernel.h"
+#include "ensemble.h"
+
+#define MAX_VALUES 16
+
+inline int parseArgs(int argc, char** argv);
+inline int parseList(const char *text, int *values, int lo, int hi);
+inline void blockRange(int n, int parts, int index, int *offset, int *size);
+inline ReplicaParams replicaParams(int replica);
+inline void initPacks();
+inline void step();
+inline void countReplicas();
+inline void writeStats();
+inline void printBench(int extinct, int totalPacks);
+
+int ROWS = 64, COLS = 0, STEPS = 1000, GEN = 0;
+int replicas = 64;
+unsigned seed;
+
+// Valori dei parametri delle regole: ogni replica usa una delle combinazioni
+int seedMins[MAX_VALUES] = {3}, seedMinCount = 1;
+int crowdings[MAX_VALUES] = {5}, crowdingCount = 1;
+int infectionOdds[MAX_VALUES] = {INFECTION_ODDS}, infectionCount = 1;
+int lateDeathOdds[MAX_VALUES] = {LATE_DEATH_ODDS}, lateDeathCount = 1;
+
+// Repliche di questo processo (da firstReplica) e loro pacchetti da 64
+int firstReplica, localReplicas, packCount;
+ReplicaPack *packs;
+PackScratch scratch;
+lanes_t *scratchMem;
+
+// Generazione in cui si sono estinti i parassiti di ogni replica locale (-1 = non ancora)
+int *extinctGen;
+
+// Statistiche: popolazioni delle repliche locali (STATE_COUNT per replica) e, sul processo 0,
+// di tutte le repliche, raccolte ogni statsEvery generazioni
+const char *statsPath = NULL;
+int statsEvery = 100;
+FILE *statsFile;
+uint64_t *population, *allPopulation;
+int *allExtinct, *gatherCounts, *gatherDispls, *extinctCounts, *extinctDispls;
+long statsRows = 0;
+
+int rank, nprocs;
+double start_time, loop_time, end_time, compute_time = 0, stats_time = 0;
+
+int main(int argc, char** argv){
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    seed = (unsigned)time(NULL);
+    if(parseArgs(argc, argv) == -1){
+        MPI_Finalize();
+        return -1;
+    }
+    if(COLS == 0)
+        COLS = ROWS;
+
+    // Il seed del processo 0 viene usato da tutti, così --seed basta su un solo processo
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+
+    start_time = MPI_Wtime();
+
+    blockRange(replicas, nprocs, rank, &firstReplica, &localReplicas);
+    initPacks();
+
+    population = (uint64_t*) malloc(((size_t)localReplicas + 1)*STATE_COUNT*sizeof(uint64_t));
+    extinctGen = (int*) malloc(((size_t)localReplicas + 1)*sizeof(int));
+    for(int i = 0; i < localReplicas; ++i)
+        extinctGen[i] = -1;
+
+    if(rank == 0){
+        allPopulation = (uint64_t*) malloc((size_t)replicas*STATE_COUNT*sizeof(uint64_t));
+        allExtinct = (int*) malloc(replicas*sizeof(int));
+        gatherCounts = (int*) malloc(4*nprocs*sizeof(int));
+        gatherDispls = gatherCounts + nprocs;
+        extinctCounts = gatherCounts + 2*nprocs;
+        extinctDispls = gatherCounts + 3*nprocs;
+        for(int r = 0; r < nprocs; ++r){
+            int first, count;
+            blockRange(replicas, nprocs, r, &first, &count);
+            gatherCounts[r] = count*STATE_COUNT;
+            gatherDispls[r] = first*STATE_COUNT;
+            extinctCounts[r] = count;
+            extinctDispls[r] = first;
+        }
+
+        if(statsPath){
+            statsFile = fopen(statsPath, "w");
+            if(statsFile == NULL){
+                printf("Error: cannot create statistics file %s!\n", statsPath);
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            }
+            fprintf(statsFile, "replica,seed,seed_min,crowding,infection_odds,late_death_odds,gen,extinct_gen,"
+                               "empty,parasite,seeded_grass,growing_grass,grown_grass\n");
+        }
+    }
+
+    if(statsPath)
+        writeStats();
+
+    loop_time = MPI_Wtime();
+
+    while(GEN < STEPS){
+        double phase_time = MPI_Wtime();
+        step();
+        GEN++;
+        double stats_start = MPI_Wtime();
+        compute_time += stats_start - phase_time;
+
+        if(statsPath && (GEN % statsEvery == 0 || GEN == STEPS))
+            writeStats();
+        stats_time += MPI_Wtime() - stats_start;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    end_time = MPI_Wtime();
+
+    // Repliche in cui i parassiti si sono estinti, sommate su tutti i processi
+    int extinct = 0, totalPacks;
+    for(int i = 0; i < localReplicas; ++i)
+        extinct += extinctGen[i] >= 0;
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &extinct, &extinct, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&packCount, &totalPacks, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if(rank == 0){
+        printf("ROWS: %d --- COLS: %d\n", ROWS, COLS);
+        printf("STEPS: %d --- REPLICAS: %d\n", GEN, replicas);
+        printBench(extinct, totalPacks);
+        if(statsFile)
+            fclose(statsFile);
+        free(allPopulation);
+        free(allExtinct);
+        free(gatherCounts);
+    }
+
+    for(int k = 0; k < packCount; ++k){
+        free(packs[k].read);
+        free(packs[k].write);
+    }
+    free(packs);
+    free(scratchMem);
+    free(population);
+    free(extinctGen);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// Pacchetti delle repliche locali: la replica firstReplica + 64*k + lane è nel bit lane del pacchetto k
+void initPacks(){
+    packCount = (localReplicas + ENSEMBLE_LANES - 1) / ENSEMBLE_LANES;
+    packs = (ReplicaPack*) calloc(packCount > 0 ? packCount : 1, sizeof(ReplicaPack));
+
+    for(int k = 0; k < packCount; ++k){
+        ReplicaPack &p = packs[k];
+        p.count = localReplicas - k*ENSEMBLE_LANES < ENSEMBLE_LANES ? localReplicas - k*ENSEMBLE_LANES : ENSEMBLE_LANES;
+        p.used = p.count == ENSEMBLE_LANES ? ~0ull : (1ull << p.count) - 1;
+        p.read = (lanes_t*) malloc(packPlanes(ROWS, COLS)*sizeof(lanes_t));
+        p.write = (lanes_t*) malloc(packPlanes(ROWS, COLS)*sizeof(lanes_t));
+        if(p.read == NULL || p.write == NULL){
+            printf("Error: failed to allocate %d replicas of %dx%d cells!\n", p.count, ROWS, COLS);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        for(int lane = 0; lane < p.count; ++lane)
+            setReplica(p, lane, replicaParams(firstReplica + k*ENSEMBLE_LANES + lane));
+        initPack(p, ROWS, COLS);
+    }
+
+    scratchMem = (lanes_t*) malloc(packScratchSize(COLS)*sizeof(lanes_t));
+    scratch = makePackScratch(scratchMem, COLS);
+}
+
+// Seed e soglie della replica: le combinazioni dei parametri si ripetono lungo le repliche
+ReplicaParams replicaParams(int replica){
+    ReplicaParams params;
+    int combination = replica % (seedMinCount*crowdingCount*infectionCount*lateDeathCount);
+
+    params.seed = seed + (unsigned)replica;
+    params.lateDeathOdds = lateDeathOdds[combination % lateDeathCount];
+    combination /= lateDeathCount;
+    params.infectionOdds = infectionOdds[combination % infectionCount];
+    combination /= infectionCount;
+    params.crowding = crowdings[combination % crowdingCount];
+    combination /= crowdingCount;
+    params.seedMin = seedMins[combination];
+    return params;
+}
+
+// Una generazione di tutte le repliche locali; le repliche senza più parassiti vengono segnate estinte
+void step(){
+    for(int k = 0; k < packCount; ++k){
+        ReplicaPack &p = packs[k];
+        lanes_t alive = 0;
+        for(int r = 0; r < ROWS; ++r)
+            alive |= packRow(p, r, COLS, GEN, scratch);
+
+        lanes_t *tmp = p.read;
+        p.read = p.write;
+        p.write = tmp;
+
+        for(int lane = 0; lane < p.count; ++lane){
+            int &extinct = extinctGen[k*ENSEMBLE_LANES + lane];
+            if(extinct < 0 && !((alive >> lane) & 1))
+                extinct = GEN + 1;
+        }
+    }
+}
+
+// Popolazioni delle repliche locali della generazione corrente
+void countReplicas(){
+    for(int k = 0; k < packCount; ++k)
+        countPack(packs[k], ROWS, COLS, population + (size_t)k*ENSEMBLE_LANES*STATE_COUNT);
+}
+
+// Popolazioni di tutte le repliche raccolte sul processo 0 e scritte nel CSV, una riga per replica
+void writeStats(){
+    countReplicas();
+    MPI_Gatherv(population, localReplicas*STATE_COUNT, MPI_UINT64_T, allPopulation, gatherCounts, gatherDispls,
+                MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(extinctGen, localReplicas, MPI_INT, allExtinct, extinctCounts, extinctDispls, MPI_INT, 0, MPI_COMM_WORLD);
+    if(rank != 0)
+        return;
+
+    for(int i = 0; i < replicas; ++i){
+        ReplicaParams params = replicaParams(i);
+        const uint64_t *row = allPopulation + (size_t)i*STATE_COUNT;
+        fprintf(statsFile, "%d,%u,%d,%d,%d,%d,%d,%d", i, params.seed, params.seedMin, params.crowding,
+                params.infectionOdds, params.lateDeathOdds, GEN, allExtinct[i]);
+        for(int s = 0; s < STATE_COUNT; ++s)
+            fprintf(statsFile, ",%llu", (unsigned long long)row[s]);
+        fputc('\n', statsFile);
+    }
+    statsRows += replicas;
+}
+
+// Lettura delle opzioni da riga di comando; restituisce -1 se il programma deve terminare
+int parseArgs(int argc, char** argv){
+    static struct option longOptions[] = {
+        {"rows",            required_argument, 0, 'r'},
+        {"cols",            required_argument, 0, 'c'},
+        {"steps",           required_argument, 0, 's'},
+        {"seed",            required_argument, 0, 'S'},
+        {"replicas",        required_argument, 0, 'N'},
+        {"seed-min",        required_argument, 0, 'g'},
+        {"crowding",        required_argument, 0, 'p'},
+        {"infection-odds",  required_argument, 0, 'i'},
+        {"late-death-odds", required_argument, 0, 'l'},
+        {"stats",           required_argument, 0, 'a'},
+        {"stats-every",     required_argument, 0, 'b'},
+        {"help",            no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    opterr = (rank == 0);   // gli errori di getopt vengono stampati una sola volta
+    while((opt = getopt_long(argc, argv, "r:c:s:S:N:g:p:i:l:a:b:h", longOptions, NULL)) != -1){
+        switch(opt){
+            case 'r': ROWS = atoi(optarg); break;
+            case 'c': COLS = atoi(optarg); break;
+            case 's': STEPS = atoi(optarg); break;
+            case 'S': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'N': replicas = atoi(optarg); break;
+            case 'g': seedMinCount = parseList(optarg, seedMins, 0, 15); break;
+            case 'p': crowdingCount = parseList(optarg, crowdings, 0, 15); break;
+            case 'i': infectionCount = parseList(optarg, infectionOdds, 0, RANDOM_RANGE); break;
+            case 'l': lateDeathCount = parseList(optarg, lateDeathOdds, 0, RANDOM_RANGE); break;
+            case 'a': statsPath = optarg; break;
+            case 'b': statsEvery = atoi(optarg); break;
+
+            default:
+                if(rank == 0)
+                    printf("Usage: %s [--rows N] [--cols N] [--steps N] [--seed N] [--replicas N] [--seed-min N,N,...] [--crowding N,N,...] [--infection-odds N,N,...] [--late-death-odds N,N,...] [--stats FILE] [--stats-every N]\n", argv[0]);
+                return -1;
+        }
+    }
+
+    if(ROWS <= 0 || COLS < 0 || STEPS < 0 || replicas <= 0 || statsEvery <= 0){
+        if(rank == 0)
+            printf("Error: invalid grid size, steps, replicas or stats interval!\n");
+        return -1;
+    }
+    if(seedMinCount == 0 || crowdingCount == 0 || infectionCount == 0 || lateDeathCount == 0){
+        if(rank == 0)
+            printf("Error: rule parameters must be lists of at most %d values (thresholds 0-15, odds 0-%d)!\n", MAX_VALUES, RANDOM_RANGE);
+        return -1;
+    }
+    return 0;
+}
+
+// Lista di interi tra lo e hi separati da virgole (al più MAX_VALUES); restituisce quanti ne ha letti, 0 se non è valida
+int parseList(const char *text, int *values, int lo, int hi){
+    int n = 0;
+    char *end;
+    while(n < MAX_VALUES){
+        long v = strtol(text, &end, 10);
+        if(end == text || v < lo || v > hi)
+            return 0;
+        values[n++] = (int)v;
+        if(*end != ',')
+            return *end == '\0' ? n : 0;
+        text = end + 1;
+    }
+    return 0;
+}
+
+// Divisione di n repliche in parts blocchi: i primi n % parts blocchi hanno un elemento in più
+void blockRange(int n, int parts, int index, int *offset, int *size){
+    *size = n/parts + (index < n%parts);
+    *offset = index*(n/parts) + (index < n%parts ? index : n%parts);
+}
+
+// Riga di benchmark leggibile da script: tempi in secondi, throughput calcolato sul solo ciclo principale
+void printBench(int extinct, int totalPacks){
+    double wall = end_time - loop_time;
+    double replicaGens = (double)replicas * GEN;
+
+    printf("BENCH engine=ensemble ranks=%d replicas=%d packs=%d rows=%d cols=%d steps=%d seed=%u "
+           "wall_s=%.6f init_s=%.6f compute_s=%.6f stats_s=%.6f replica_gens_per_s=%.3f cell_updates_per_s=%.6e "
+           "extinct=%d stats_rows=%ld\n",
+           nprocs, replicas, totalPacks, ROWS, COLS, GEN, seed,
+           wall, loop_time - start_time, compute_time, stats_time,
+           wall > 0 ? replicaGens / wall : 0.0, wall > 0 ? replicaGens * ROWS * COLS / wall : 0.0,
+           extinct, statsRows);
+    fflush(stdout);
+}
@@ -1,57 +1,124 @@
 /*
 ---------- VERSIONE SERIALE ----------
 COMANDO PER COMPILARE ED ESEGUIRE IL CODICE:
-> g++ parasites_serial.cpp -lallegro -lallegro_primitives
+> g++ parasites_serial.cpp -lallegro
 > ./a.out
+
+MODALITA' BENCHMARK (senza display, parametri a runtime):
+> ./a.out --headless --rows 2000 --cols 2000 --steps 500 --seed 42
+Al termine viene stampata una riga "BENCH key=value ..." leggibile da script.
+
+BLOCKING TEMPORALE (temporal.h): --fuse T calcola T generazioni per ogni passata sulla
+memoria (con la grafica, si vede una generazione ogni T):
+> ./a.out --headless --rows 8000 --cols 8000 --steps 200 --fuse 4
+
+REGISTRAZIONE (record.h): --record FILE registra ogni generazione calcolata, da rivedere con replay.cpp
+> ./a.out --headless --steps 5000 --record run.rec
+
+STATISTICHE (stats.h): --stats FILE scrive in CSV la popolazione di ogni stato e le transizioni
+di ogni generazione, contate dal kernel durante il calcolo
+> ./a.out --headless --steps 5000 --stats run.csv
+
+BORDI PERIODICI: per default le celle fuori dalla griglia sono EMPTY; con --torus la griglia si
+richiude su sé stessa e prima di ogni passata la cornice viene riempita con il lato opposto
+> ./a.out --headless --torus --steps 5000
 */
 
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <time.h>
+#include <getopt.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <allegro5/allegro.h>
-#include <allegro5/allegro_primitives.h>
+#include "kernel.h"
+#include "rng.h"
+#include "render.h"
+#include "temporal.h"
+#include "record.h"
+#include "stats.h"
 
-#define ROWS 300
-#define COLS 300
-#define STEPS 1000
-#define SIZE_CELL 4
 #define TITLE "Parasites - Emanuele Conforti (220270)"
 
-#define coords(r, c) ((r) * COLS + (c)) // per trasformare gli indici di matrice in indici di array
+// per trasformare gli indici di matrice in indici di array: la matrice ha una cornice profonda FRAME
+// celle (righe da -FRAME a -1 e da ROWS, colonne da -FRAME a -1 e da COLS) letta dal kernel come
+// vicinato delle celle di bordo: EMPTY, oppure con --torus una copia del lato opposto (wrapFrame()),
+// profonda quanto le generazioni di una passata. STRIDE = COLS + 2*FRAME è la lunghezza di una riga
+#define coords(r, c) (((r) + FRAME) * STRIDE + (c) + FRAME)
+
 
+// Stati, tipo delle celle (un byte) e kernel di riga sono definiti in kernel.h
 
-// Stati in cui si può trovare una cella: 
-// -EMPTY
-// -PARASITE è il predatore
-// -GRASS è la preda, ha 3 sotto-stati: SEEDED, GROWING, GROWN
-// 
-// Transizioni di stato: 
-// EMPTY -> SEEDED -> GROWING -> GROWN -> PARASITE -> EMPTY...
+int ROWS = 300, COLS = 300, STEPS = 1000, SIZE_CELL = 4;
+int FRAME = 1, STRIDE;
 
-enum states {EMPTY = 0, PARASITE, SEEDED_GRASS, GROWING_GRASS, GROWN_GRASS};
+// Opzioni da riga di comando: headless disattiva la grafica (e quindi la pausa di print())
+bool headless = false, hugePages = false, forceScalar = false;
 
-unsigned *seed = new unsigned(time(NULL));
+// Bordi periodici (--torus) invece della cornice EMPTY
+bool torus = false;
+
+unsigned seed = time(NULL);
 // Generatore di numeri casuali
 // I numeri casuali serviranno nella funzione di transizione
 // per fare in modo che i predatori non mangino tutte le prede o non muoiano.
 // In pratica, aiutano a raggiungere un equilibrio tra le due parti, in modo da
 // rendere il programma infinito.
-
-int *read_matrix;
-int *write_matrix;
+// Il generatore (rng.h) è basato su contatore: ogni cella usa (seed, GEN, riga, colonna),
+// quindi a parità di seed la griglia è identica a quella della versione MPI.
+
+cell_t *read_matrix;
+cell_t *write_matrix;
+
+// Kernel di riga scelto a runtime (AVX2 o scalare) e relativo buffer di lavoro
+RowKernel transRow;
+const char *kernelName;
+RowScratch scratch;
+
+// Generazioni per passata (1 = una generazione alla volta), colonne per striscia (0 = scelte in base
+// alla cache L2) e buffer del blocking temporale
+int fuseSteps = 1, stripWidth = 0;
+FusedScratch fused;
+
+// Registrazione compressa delle generazioni
+const char *recordPath = NULL;
+Recorder recorder;
+
+// Statistiche di popolazione: transizioni contate dal kernel (una riga per ogni generazione di una
+// passata) e riga della generazione corrente
+const char *statsPath = NULL;
+StatsWriter stats;
+uint64_t transitions[FUSED_MAX][TRANSITION_COUNT];
+uint64_t statsRow[STATS_FIELDS];
+
+// Numero di allocazioni delle matrici: il ciclo principale non deve farne nessuna
+long allocations = 0, loopAllocations = 0;
 int size, stop = 0, GEN = 0;  // Nelle iterazioni con GEN % 2 == 0, faccio sviluppare solo l'erba
                     // mentre nelle iterazioni con GEN % 2 != 0, faccio sviluppare solo i parassiti
+// Timer delle fasi: inizializzazione, calcolo (funzione di transizione + swap), output (stampa)
+double start_time, loop_time, end_time, compute_time = 0, output_time = 0;
+
 // Allegro graphics
 ALLEGRO_DISPLAY *display;
 ALLEGRO_EVENT event;
 ALLEGRO_EVENT_QUEUE *queue;
+FrameRenderer *renderer;
 
 void init();
-void transFunc(int r, int c);
+void transFunc(int r);
+void fusedPass(int steps);
+inline void wrapFrame();
 inline void swap();
+inline void writeStats(int steps);
 inline void finalize();
+inline cell_t* allocMatrix(size_t cells);
+inline void freeMatrix(cell_t* m);
+inline int parseArgs(int argc, char *argv[]);
+inline double wtime();
+inline void printBench();
 
 // Allegro graphics
 inline int init_allegro();
@@ -61,41 +128,178 @@ inline void print();
 
 int main(int argc, char *argv[])
 {
+    if(parseArgs(argc, argv) == -1)
+        return -1;
+
+    start_time = wtime();
+
     init();
-    if(init_allegro() == -1)
+    if(!headless && init_allegro() == -1)
+        return -1;
+    if(recordPath && !recorder.open(recordPath, ROWS, COLS, seed)) {
+        printf("Errore: impossibile creare la registrazione %s...\n", recordPath);
         return -1;
+    }
+    if(statsPath) {
+        if(!stats.open(statsPath)) {
+            printf("Errore: impossibile creare il file di statistiche %s...\n", statsPath);
+            return -1;
+        }
+        for(int r = 0; r < ROWS; ++r)
+            countStates(&read_matrix[coords(r,0)], COLS, statsRow);
+        stats.write(GEN, statsRow);
+    }
+
+    loop_time = wtime();
+    long allocationsBeforeLoop = allocations;
 
     while(!stop && GEN < STEPS)
     {
-        for (int r = 0; r < ROWS; ++r)
-            for (int c = 0; c < COLS; ++c)
-                transFunc(r, c);
+        double phase_time = wtime();
+        int advance = STEPS - GEN < fuseSteps ? STEPS - GEN : fuseSteps;
+
+        if(torus)
+            wrapFrame();
+        if(advance > 1)
+            fusedPass(advance);
+        else
+            for (int r = 0; r < ROWS; ++r)
+                transFunc(r);
         swap();
 
-        print();
-        GEN++;
-        al_peek_next_event(queue, &event);
-        if(event.type == ALLEGRO_EVENT_DISPLAY_CLOSE)
-            stop = 1;
+        double output_start = wtime();
+        compute_time += output_start - phase_time;
+
+        if(!headless) {
+            print();
+            al_peek_next_event(queue, &event);
+            if(event.type == ALLEGRO_EVENT_DISPLAY_CLOSE)
+                stop = 1;
+        }
+        if(stats.isOpen())
+            writeStats(advance);
+        GEN += advance;
+        if(recorder.isOpen())
+            recorder.write(&read_matrix[coords(0,0)], STRIDE, GEN);
+
+        output_time += wtime() - output_start;
     }
 
-    finalize_allegro();
+    end_time = wtime();
+    loopAllocations = allocations - allocationsBeforeLoop;
+    printBench();
+
+    if(!headless)
+        finalize_allegro();
     finalize();
     return 0;
 }
 
+// Lettura delle opzioni da riga di comando; restituisce -1 se il programma deve terminare
+inline int parseArgs(int argc, char *argv[])
+{
+    static struct option longOptions[] = {
+        {"headless",  no_argument,       0, 'n'},
+        {"rows",      required_argument, 0, 'r'},
+        {"cols",      required_argument, 0, 'c'},
+        {"steps",     required_argument, 0, 's'},
+        {"seed",      required_argument, 0, 'S'},
+        {"cell-size", required_argument, 0, 'z'},
+        {"hugepages", no_argument,       0, 'H'},
+        {"scalar",    no_argument,       0, 'x'},
+        {"fuse",      required_argument, 0, 'f'},
+        {"strip-cols",required_argument, 0, 'w'},
+        {"record",    required_argument, 0, 'e'},
+        {"stats",     required_argument, 0, 'a'},
+        {"torus",     no_argument,       0, 'W'},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while((opt = getopt_long(argc, argv, "nr:c:s:S:z:Hxf:w:e:a:Wh", longOptions, NULL)) != -1) {
+        switch(opt) {
+            case 'n': headless = true; break;
+            case 'r': ROWS = atoi(optarg); break;
+            case 'c': COLS = atoi(optarg); break;
+            case 's': STEPS = atoi(optarg); break;
+            case 'S': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'z': SIZE_CELL = atoi(optarg); break;
+            case 'H': hugePages = true; break;
+            case 'x': forceScalar = true; break;
+            case 'f': fuseSteps = atoi(optarg); break;
+            case 'w': stripWidth = atoi(optarg); break;
+            case 'e': recordPath = optarg; break;
+            case 'a': statsPath = optarg; break;
+            case 'W': torus = true; break;
+
+            default:
+                printf("Uso: %s [--headless] [--rows N] [--cols N] [--steps N] [--seed N] [--cell-size PX] [--hugepages] [--scalar] [--fuse T] [--strip-cols N] [--record FILE] [--stats FILE] [--torus]\n", argv[0]);
+                return -1;
+        }
+    }
+
+    if(ROWS <= 0 || COLS <= 0 || STEPS < 0 || SIZE_CELL <= 0 || fuseSteps <= 0 || fuseSteps > FUSED_MAX || stripWidth < 0) {
+        printf("Errore: dimensioni della griglia, passi, dimensione delle celle o generazioni per passata non validi...\n");
+        return -1;
+    }
+    // La cornice periodica viene copiata dal lato opposto della griglia, che deve essere abbastanza grande
+    if(torus && (ROWS < fuseSteps || COLS < fuseSteps)) {
+        printf("Errore: con --torus la griglia deve avere almeno %d righe e colonne (--fuse)...\n", fuseSteps);
+        return -1;
+    }
+    return 0;
+}
+
+inline double wtime()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Riga di benchmark leggibile da script: tempi in secondi, throughput calcolato sul solo ciclo principale
+inline void printBench()
+{
+    double wall = end_time - loop_time;
+    double gensPerSec = wall > 0 ? GEN / wall : 0;
+
+    printf("BENCH engine=serial kernel=%s ranks=1 rows=%d cols=%d steps=%d seed=%u headless=%d "
+           "wall_s=%.6f init_s=%.6f compute_s=%.6f output_s=%.6f gens_per_s=%.3f cell_updates_per_s=%.6e "
+           "allocs=%ld loop_allocs=%ld fuse=%d strip_cols=%d record_frames=%ld record_bytes=%ld stats_rows=%ld torus=%d\n",
+           kernelName, ROWS, COLS, GEN, seed, headless ? 1 : 0,
+           wall, loop_time - start_time, compute_time, output_time,
+           gensPerSec, gensPerSec * (double)ROWS * COLS,
+           allocations, loopAllocations, fuseSteps, fuseSteps > 1 ? stripWidth : COLS,
+           recorder.frameCount(), recorder.stored(), stats.rowCount(), torus ? 1 : 0);
+    fflush(stdout);
+}
+
 // L'inizializzazione prevede una matrice di GROWN_GRASS e un PARASITE al centro
 inline void init()
 {
-    size = ROWS * COLS;
-    read_matrix = new int[size];
-    write_matrix = new int[size];
-
-    int mid = ROWS / 2;
+    FRAME = torus ? fuseSteps : 1;
+    STRIDE = COLS + 2*FRAME;
+    size = (ROWS + 2*FRAME) * STRIDE;
+    // Due buffer persistenti, allocati una sola volta e scambiati per puntatore in swap()
+    read_matrix = allocMatrix(size);
+    write_matrix = allocMatrix(size);
+
+    transRow = selectKernel(forceScalar, &kernelName);
+    scratch = makeScratch(allocMatrix(scratchSize(COLS)), COLS);
+    if(fuseSteps > 1) {
+        fused = makeFusedScratch(allocMatrix(fusedScratchSize(STRIDE)), STRIDE);
+        if(stripWidth == 0)
+            stripWidth = fusedStripWidth(COLS, fuseSteps, 1);
+    }
+    if(statsPath) {
+        scratch.counts = transitions[0];
+        fused.counts = transitions[0];
+    }
 
     for(int i = 0; i < ROWS; i++) {
         for(int j = 0; j < COLS; j++) {
-            if(i == mid && j == mid)
+            if(i == ROWS / 2 && j == COLS / 2)
                 read_matrix[coords(i,j)] = PARASITE;
     
             else read_matrix[coords(i,j)] = GROWN_GRASS;
@@ -103,180 +307,148 @@ inline void init()
     }
 }
 
+// La griglia viene disegnata come texture (render.h), riga r in verticale e colonna c in orizzontale
 inline void print()
 {
-    al_clear_to_color(al_map_rgb(0, 0, 0));
-
-    for (int i = 0; i < ROWS; ++i)
-    {
-        for (int j = 0; j < COLS; ++j)
-        {
-            if (read_matrix[coords(i,j)] == PARASITE)  
-                al_draw_filled_rectangle(i * SIZE_CELL, j * SIZE_CELL, i * SIZE_CELL + SIZE_CELL, j * SIZE_CELL + SIZE_CELL, al_map_rgb(255,0,0));
-
-            else if (read_matrix[coords(i,j)] == SEEDED_GRASS)  
-                al_draw_filled_rectangle(i * SIZE_CELL, j * SIZE_CELL, i * SIZE_CELL + SIZE_CELL, j * SIZE_CELL + SIZE_CELL, al_map_rgb(34,139,34));
-
-            else if (read_matrix[coords(i,j)] == GROWING_GRASS)  
-                al_draw_filled_rectangle(i * SIZE_CELL, j * SIZE_CELL, i * SIZE_CELL + SIZE_CELL, j * SIZE_CELL + SIZE_CELL, al_map_rgb(50,205,50));
-            
-            else if (read_matrix[coords(i,j)] == GROWN_GRASS)  
-                al_draw_filled_rectangle(i * SIZE_CELL, j * SIZE_CELL, i * SIZE_CELL + SIZE_CELL, j * SIZE_CELL + SIZE_CELL, al_map_rgb(0,255,0));
-            
-            else al_draw_filled_rectangle(i * SIZE_CELL, j * SIZE_CELL, i * SIZE_CELL + SIZE_CELL, j * SIZE_CELL + SIZE_CELL, al_map_rgb(0,0,0));
-
-        }
-    }
-
+    renderer->draw(&read_matrix[coords(0,0)], STRIDE);
     al_flip_display();
     al_rest(1.0 / 30.0);
 }
 
 inline int init_allegro()
 {
-    al_init();
-    display = al_create_display(COLS * SIZE_CELL, ROWS * SIZE_CELL);
-    queue = al_create_event_queue();
-    al_init_primitives_addon();
-    al_register_event_source(queue, al_get_display_event_source(display));
-    al_set_window_title(display, TITLE);
-
     if(!al_init()) {
         printf("Errore: impossibile inizializzare allegro...\n");
         return -1;
     }
+
+    int width, height;
+    windowSize(ROWS, COLS, SIZE_CELL, &width, &height);
+    display = al_create_display(width, height);
+    if(!display) {
+        printf("Errore: impossibile creare una finestra %dx%d...\n", width, height);
+        return -1;
+    }
+    queue = al_create_event_queue();
+    renderer = new FrameRenderer(ROWS, COLS, width, height);
+    if(!renderer->valid()) {
+        printf("Errore: impossibile creare la bitmap dei frame...\n");
+        return -1;
+    }
+
+    al_register_event_source(queue, al_get_display_event_source(display));
+    al_set_window_title(display, TITLE);
     return 0;
 }
 
 
-void transFunc(int r, int c)
-{   
-    int numParasiteCells = 0, numGrassCells = 0, numEmptyCells = 0, randNum;
-    bool parasiteFound = false;
-
-    if(GEN % 2 == 0) { // Eseguo la funzione di transizione solo sulle celle GRASS e EMPTY
-        switch(read_matrix[coords(r,c)]) {
-            case GROWN_GRASS:
-                write_matrix[coords(r,c)] = GROWN_GRASS;
-                break;     
-
-            case GROWING_GRASS: // GROWING_GRASS -> GROWN_GRASS
-                write_matrix[coords(r,c)] = GROWN_GRASS;
-                break;
-
-            case SEEDED_GRASS: // SEEDED_GRASS -> GROWING_GRASS
-                write_matrix[coords(r,c)] = GROWING_GRASS;
-                break;
-
-            case PARASITE:
-                write_matrix[coords(r,c)] = PARASITE;   
-                break;
-
-            // ------------------------------------------------------
-            // Se una cella EMPTY ha 3 o più vicini GROWN_GRASS,
-            // allora diventa GRASS (SEEDED, perchè appena seminato);
-            // altrimenti, rimane EMPTY
-
-            case EMPTY:
-                for (int i = -1; i <= 1; ++i)
-                    for (int j = -1; j <= 1; ++j)
-                        if((r+i) < ROWS && (r+i) >= 0 && (c+j) < COLS && (c+j) >= 0)
-                            if(read_matrix[coords(r+i,c+j)] == GROWN_GRASS)
-                                numGrassCells++;
-
-                if(numGrassCells >= 3)
-                    write_matrix[coords(r,c)] = SEEDED_GRASS;
-                
-                else write_matrix[coords(r,c)] = EMPTY;
-                break; 
-        }
+// Applica il kernel alla riga r
+void transFunc(int r)
+{
+    RowContext ctx = {GEN, r, 0, seed};
+
+    transRow(&read_matrix[coords(r-1,0)], &read_matrix[coords(r,0)], &read_matrix[coords(r+1,0)],
+             &write_matrix[coords(r,0)], COLS, ctx, scratch);
+}
+
+// Passata del blocking temporale: steps generazioni su tutta la griglia, una striscia di colonne
+// alla volta. Tutte le generazioni coprono l'intera griglia e la cornice resta EMPTY; con --torus
+// la generazione g+k copre anche steps-k celle della cornice, come la cornice profonda di parasites.cpp
+void fusedPass(int steps)
+{
+    FusedPlan plan;
+    plan.steps = steps;
+    for(int k = 1; k <= steps; ++k) {
+        int extra = torus ? steps - k : 0;
+        plan.region[k] = (FusedRegion){-extra, ROWS - 1 + extra, -extra, COLS - 1 + extra};
     }
+    plan.stride = STRIDE;
+    plan.colOrigin = FRAME;
+    plan.gen = GEN;
+    plan.rowOffset = plan.colOffset = 0;
+    plan.seed = seed;
+    plan.rows = torus ? ROWS : 0;
+    plan.cols = torus ? COLS : 0;
+    plan.count = plan.region[steps];
+
+    for(int c = 0; c < COLS; c += stripWidth)
+        fusedStrip(transRow, &read_matrix[coords(0,0)], &write_matrix[coords(0,0)], plan,
+                   c, c + stripWidth - 1 < COLS - 1 ? c + stripWidth - 1 : COLS - 1, fused);
+}
 
-    else { // Eseguo la funzione di transizione solo sui predatori (PARASITE)
-
-        switch(read_matrix[coords(r,c)]) {
-
-            // -------------------------------------------------------------------------
-            // Se una cella GROWN_GRASS (preda) ha almeno un vicino PARASITE (predatore)
-            // e se il numero casuale è compreso tra 1 e 5,
-            // allora la cella GROWN_GRASS diventa un PARASITE;
-            // altrimenti, rimane GROWN_GRASS
-
-            case GROWN_GRASS:
-                for (int i = -1; i <= 1 && !parasiteFound; ++i)
-                    for (int j = -1; j <= 1 && !parasiteFound; ++j)
-
-                        if((r+i) < ROWS && (r+i) >= 0 && (c+j) < COLS && (c+j) >= 0 && read_matrix[coords(r+i,c+j)] == PARASITE)
-                            parasiteFound = true;
-                
-                randNum = (rand() % 20) + 1; // Numero casuale, compreso tra 1 e 20
-                
-                if(parasiteFound && randNum <= 5) 
-                    write_matrix[coords(r,c)] = PARASITE;
-
-                else write_matrix[coords(r,c)] = GROWN_GRASS;
-                break;
-
-            case GROWING_GRASS:
-                write_matrix[coords(r,c)] = GROWING_GRASS;
-                break;
-
-            case SEEDED_GRASS:
-                write_matrix[coords(r,c)] = SEEDED_GRASS;
-                break;
-            
-            // --------------------------------------------------------------------
-            // Se una cella PARASITE ha 5 o più vicini PARASITE (sovrappopolazione)
-            // oppure non ha alcun vicino GROWN_GRASS
-            // oppure abbiamo superato la 50-esima iterazione (GEN > 50)
-            // e il numero casuale è compreso tra 1 e 5,
-            // allora muore, cioè diventa EMPTY;
-            // altrimenti, rimane PARASITE
-
-            case PARASITE:
-                for (int i = -1; i <= 1; ++i)
-                    for (int j = -1; j <= 1; ++j)
-                        if((r+i) < ROWS && (r+i) >= 0 && (c+j) < COLS && (c+j) >= 0)
-                            if(read_matrix[coords(r+i,c+j)] == PARASITE)
-                                numParasiteCells++;
-
-                            else if(read_matrix[coords(r+i,c+j)] == GROWN_GRASS)
-                                numGrassCells++;
-                
-                randNum = (rand() % 20) + 1; // Numero casuale, compreso tra 1 e 20
-
-                if(numParasiteCells >= 5 || numGrassCells == 0)
-                    write_matrix[coords(r,c)] = EMPTY;
-            
-                else if(GEN > 50 && randNum <= 5) 
-                    write_matrix[coords(r,c)] = EMPTY;
-
-                else write_matrix[coords(r,c)] = PARASITE; 
-                
-                break;
-
-            case EMPTY:
-                write_matrix[coords(r,c)] = EMPTY;
-                break;
-        }
+// Con --torus la cornice contiene le celle del lato opposto della griglia: prima le FRAME righe sopra
+// e sotto, poi le FRAME colonne a sinistra e a destra di tutte le righe memorizzate (angoli compresi)
+inline void wrapFrame()
+{
+    for(int k = 1; k <= FRAME; ++k) {
+        memcpy(&read_matrix[coords(-k,0)], &read_matrix[coords(ROWS-k,0)], COLS * sizeof(cell_t));
+        memcpy(&read_matrix[coords(ROWS-1+k,0)], &read_matrix[coords(k-1,0)], COLS * sizeof(cell_t));
+    }
+    for(int r = -FRAME; r < ROWS + FRAME; ++r) {
+        memcpy(&read_matrix[coords(r,-FRAME)], &read_matrix[coords(r,COLS-FRAME)], FRAME * sizeof(cell_t));
+        memcpy(&read_matrix[coords(r,COLS)], &read_matrix[coords(r,0)], FRAME * sizeof(cell_t));
+    }
+}
+
+// Una riga di statistiche per ognuna delle steps generazioni appena calcolate
+inline void writeStats(int steps)
+{
+    for(int k = 0; k < steps; ++k) {
+        applyTransitions(statsRow, transitions[k]);
+        stats.write(GEN + k + 1, statsRow);
     }
+    memset(transitions, 0, sizeof(transitions));
 }
 
+// Scambio dei due buffer persistenti: nessuna allocazione né azzeramento ad ogni generazione
+// (la funzione di transizione riscrive comunque tutte le celle)
 inline void swap()
 {
-    delete[] read_matrix;
+    cell_t *tmp = read_matrix;
     read_matrix = write_matrix;
-    write_matrix = new int[ROWS*COLS]{0};
+    write_matrix = tmp;
+}
+
+// Allocazione allineata alla pagina (o a 2MB con --hugepages, chiedendo al kernel le huge pages).
+// La memoria viene azzerata qui, quindi il primo accesso avviene fuori dal ciclo principale
+inline cell_t* allocMatrix(size_t cells)
+{
+    size_t alignment = hugePages ? (2 << 20) : 4096;
+    size_t bytes = (cells * sizeof(cell_t) + alignment - 1) / alignment * alignment;
+    void *m = NULL;
+
+    if(posix_memalign(&m, alignment, bytes) != 0) {
+        printf("Errore: impossibile allocare %zu byte...\n", bytes);
+        exit(-1);
+    }
+#ifdef MADV_HUGEPAGE
+    if(hugePages)
+        madvise(m, bytes, MADV_HUGEPAGE);
+#endif
+    memset(m, 0, bytes);
+    allocations++;
+    return (cell_t*) m;
+}
+
+inline void freeMatrix(cell_t *m)
+{
+    free(m);
 }
 
 inline void finalize_allegro()
 {
+    delete renderer;
     al_destroy_display(display);
     al_destroy_event_queue(queue);
 }
 
 inline void finalize()
 {
-    delete[] read_matrix;
-    delete[] write_matrix;
+    recorder.close();
+    stats.close();
+    freeMatrix(read_matrix);
+    freeMatrix(write_matrix);
+    freeMatrix(scratch.mem);
+    if(fuseSteps > 1)
+        freeMatrix(fused.rows);
 }
\ No newline at end of file
@@ -0,0 +1,133 @@
+// Profilo delle fasi di una generazione (versione MPI).
+//
+// Ogni fase del ciclo principale viene racchiusa tra begin() ed end(): due letture dell'orologio
+// monotono, una somma e l'incremento di un istogramma dei tempi per fase (intervalli in potenze
+// di 2 di microsecondi), quindi il costo è trascurabile rispetto a una generazione.
+// Con la traccia attiva ogni fase viene anche salvata come evento (inizio, durata, generazione),
+// da scrivere alla fine nel formato JSON "Trace Event" di Chrome, leggibile da chrome://tracing
+// e da Perfetto (ui.perfetto.dev): un processo MPI per riga della timeline.
+
+#ifndef PARASITES_PROFILE_H
+#define PARASITES_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+enum phases {PHASE_MARK = 0,      // markActiveTiles
+             PHASE_HALO_START,    // MPI_sendBorders
+             PHASE_INSIDE,        // transFunctionInside
+             PHASE_HALO_WAIT,     // MPI_recvBorders
+             PHASE_BORDERS,       // transFunctionBorders
+             PHASE_FUSED,         // fusedPass
+             PHASE_SWAP,          // swap
+             PHASE_GATHER,        // completeGather + startGather (e consegna del frame al disegno)
+             PHASE_CHECKPOINT,    // completeCheckpoint + startCheckpoint
+             PHASE_STATS,         // collectStats + reduceStats
+             PHASE_CONTROL,       // completeControl + startControl (MPI_Ibcast)
+             PHASE_REBALANCE,     // rebalance (migrazione delle righe tra i processi)
+             PHASE_COUNT};
+
+static const char *phaseNames[PHASE_COUNT] = {"mark", "halo_start", "inside", "halo_wait", "borders",
+                                              "fused", "swap", "gather", "checkpoint", "stats", "control",
+                                              "rebalance"};
+
+// Intervallo 0: meno di 1 microsecondo; intervallo b: da 2^(b-1) a 2^b microsecondi (l'ultimo raccoglie il resto)
+#define PROFILE_BUCKETS 32
+
+struct TraceEvent {
+    double start, duration;     // secondi dall'origine del profilo
+    int32_t gen;
+    int32_t phase;
+};
+
+class PhaseProfiler {
+public:
+    PhaseProfiler() : tracing(false), gen(0)
+    {
+        memset(totals, 0, sizeof(totals));
+        memset(calls, 0, sizeof(calls));
+        memset(histogram, 0, sizeof(histogram));
+        memset(started, 0, sizeof(started));
+        origin = now();
+    }
+
+    static double now()
+    {
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec * 1e-9;
+    }
+
+    // Origine dei tempi della traccia (da fissare insieme su tutti i processi, dopo una barriera)
+    void setOrigin() { origin = now(); }
+    void enableTrace() { tracing = true; }
+    bool tracingEnabled() const { return tracing; }
+
+    // Generazione a cui attribuire le fasi successive
+    void setGeneration(int g) { gen = g; }
+
+    void begin(int phase) { started[phase] = now(); }
+
+    void end(int phase)
+    {
+        double d = now() - started[phase];
+        totals[phase] += d;
+        calls[phase]++;
+        histogram[phase][bucket(d)]++;
+        if(tracing)
+            events.push_back((TraceEvent){started[phase] - origin, d, gen, phase});
+    }
+
+    const double *total() const { return totals; }
+    const long *callCount() const { return calls; }
+    const long *buckets() const { return &histogram[0][0]; }
+    const std::vector<TraceEvent> &trace() const { return events; }
+
+    // Limite superiore (in microsecondi) dell'intervallo b dell'istogramma
+    static long bucketLimit(int b) { return 1L << b; }
+
+private:
+    double totals[PHASE_COUNT];
+    long calls[PHASE_COUNT];
+    long histogram[PHASE_COUNT][PROFILE_BUCKETS];
+    double started[PHASE_COUNT];
+    double origin;
+    bool tracing;
+    int gen;
+    std::vector<TraceEvent> events;
+
+    static int bucket(double seconds)
+    {
+        uint64_t us = (uint64_t)(seconds * 1e6);
+        int b = us == 0 ? 0 : 64 - __builtin_clzll(us);
+        return b < PROFILE_BUCKETS ? b : PROFILE_BUCKETS - 1;
+    }
+};
+
+// Scrittura della traccia in formato Trace Event: events contiene gli eventi di tutti i processi,
+// quelli del processo r da first[r] a first[r+1]-1. Tempi in microsecondi
+inline bool writeTrace(const char *path, const TraceEvent *events, const int *first, int ranks)
+{
+    FILE *f = fopen(path, "w");
+    if(f == NULL)
+        return false;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(int r = 0; r < ranks; ++r) {
+        fprintf(f, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}",
+                r > 0 ? ",\n" : "", r, r);
+        for(int i = first[r]; i < first[r+1]; ++i) {
+            const TraceEvent &e = events[i];
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"gen\":%d}}",
+                    phaseNames[e.phase], r, e.start * 1e6, e.duration * 1e6, e.gen);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return true;
+}
+
+#endif
@@ -0,0 +1,288 @@
+// Registrazione compressa delle generazioni (e rilettura), condivisa dalle due versioni e da replay.cpp.
+//
+// Formato: un header (RecordHeader) seguito dai frame, ognuno con un piccolo header (RecordFrame)
+// e i dati compressi. Un frame chiave contiene la griglia intera, gli altri lo XOR con il frame
+// precedente, quasi tutto a zero perché la griglia cambia poco da una generazione all'altra.
+// In entrambi i casi i byte sono compressi con un run-length: la griglia è fatta in gran parte
+// di grandi zone uniformi (GROWN_GRASS). Un frame chiave ogni RECORD_KEY_INTERVAL permette di
+// ripartire dall'inizio di un blocco. Gli interi sono little-endian.
+//
+// Codifica run-length: una sequenza di token, ognuno con un intero varint h seguito da
+// - se h è dispari: un byte, ripetuto (h >> 1) + 1 volte;
+// - se h è pari: (h >> 1) + 1 byte copiati così come sono.
+
+#ifndef PARASITES_RECORD_H
+#define PARASITES_RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "kernel.h"
+
+#define RECORD_MAGIC "PARAREC1"
+#define RECORD_VERSION 1
+#define RECORD_KEY_INTERVAL 64
+
+// Ripetizioni minime per usare un token di run invece di un letterale
+#define RECORD_MIN_RUN 3
+
+struct RecordHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t rows, cols;
+    uint32_t seed;
+    uint32_t keyInterval;
+    uint32_t reserved;
+};
+
+struct RecordFrame {
+    uint32_t gen;
+    uint32_t key;          // 1 = griglia intera, 0 = XOR con il frame precedente
+    uint32_t bytes;        // dimensione dei dati compressi che seguono
+};
+
+inline void putVarint(std::vector<uint8_t> &out, uint64_t v)
+{
+    while(v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t *v)
+{
+    *v = 0;
+    for(int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if(!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Compressione run-length di n byte, aggiunti in coda a out
+inline void rlePack(const uint8_t *src, size_t n, std::vector<uint8_t> &out)
+{
+    size_t literal = 0;     // inizio del letterale in corso
+
+    for(size_t i = 0; i < n; ) {
+        size_t run = 1;
+        while(i + run < n && src[i + run] == src[i])
+            run++;
+
+        if(run < RECORD_MIN_RUN) {
+            i += run;
+            continue;
+        }
+
+        if(literal < i) {
+            putVarint(out, (uint64_t)(i - literal - 1) << 1);
+            out.insert(out.end(), src + literal, src + i);
+        }
+        putVarint(out, (uint64_t)(run - 1) << 1 | 1);
+        out.push_back(src[i]);
+        i += run;
+        literal = i;
+    }
+
+    if(literal < n) {
+        putVarint(out, (uint64_t)(n - literal - 1) << 1);
+        out.insert(out.end(), src + literal, src + n);
+    }
+}
+
+// Decompressione in esattamente n byte; false se i dati non sono validi
+inline bool rleUnpack(const uint8_t *src, size_t bytes, uint8_t *dst, size_t n)
+{
+    const uint8_t *p = src, *end = src + bytes;
+    size_t i = 0;
+
+    while(p < end) {
+        uint64_t h;
+        if(!getVarint(p, end, &h))
+            return false;
+
+        size_t len = (size_t)(h >> 1) + 1;
+        if(len > n - i)
+            return false;
+
+        if(h & 1) {
+            if(p >= end)
+                return false;
+            memset(dst + i, *p++, len);
+        }
+        else {
+            if(len > (size_t)(end - p))
+                return false;
+            memcpy(dst + i, p, len);
+            p += len;
+        }
+        i += len;
+    }
+    return i == n;
+}
+
+// Scrittura di una registrazione
+class Recorder {
+public:
+    Recorder() : file(NULL), rows(0), cols(0), frames(0), rawBytes(0), storedBytes(0) {}
+    ~Recorder() { close(); }
+
+    bool open(const char *path, int rows, int cols, uint32_t seed)
+    {
+        file = fopen(path, "wb");
+        if(file == NULL)
+            return false;
+
+        this->rows = rows;
+        this->cols = cols;
+        previous.assign((size_t)rows * cols, 0);
+        current.resize((size_t)rows * cols);
+
+        RecordHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, RECORD_MAGIC, 8);
+        h.version = RECORD_VERSION;
+        h.rows = rows;
+        h.cols = cols;
+        h.seed = seed;
+        h.keyInterval = RECORD_KEY_INTERVAL;
+        fwrite(&h, sizeof(h), 1, file);
+        storedBytes = sizeof(h);
+        return true;
+    }
+
+    // Aggiunge la generazione gen: grid punta alla cella (0,0), pitch è la distanza in celle tra due righe
+    void write(const cell_t *grid, size_t pitch, int gen)
+    {
+        bool key = frames % RECORD_KEY_INTERVAL == 0;
+
+        for(int r = 0; r < rows; ++r) {
+            cell_t *row = &current[(size_t)r * cols];
+            const cell_t *prev = &previous[(size_t)r * cols];
+            memcpy(row, grid + (size_t)r * pitch, cols);
+            if(!key)
+                for(int c = 0; c < cols; ++c)
+                    row[c] ^= prev[c];
+        }
+
+        packed.clear();
+        rlePack(current.data(), current.size(), packed);
+
+        RecordFrame f = {(uint32_t)gen, key ? 1u : 0u, (uint32_t)packed.size()};
+        fwrite(&f, sizeof(f), 1, file);
+        fwrite(packed.data(), 1, packed.size(), file);
+
+        // previous torna a contenere la griglia (e non la differenza)
+        for(int r = 0; r < rows; ++r)
+            memcpy(&previous[(size_t)r * cols], grid + (size_t)r * pitch, cols);
+
+        frames++;
+        rawBytes += (long)rows * cols;
+        storedBytes += sizeof(f) + packed.size();
+    }
+
+    void close()
+    {
+        if(file)
+            fclose(file);
+        file = NULL;
+    }
+
+    bool isOpen() const { return file != NULL; }
+    long frameCount() const { return frames; }
+    long raw() const { return rawBytes; }
+    long stored() const { return storedBytes; }
+
+private:
+    FILE *file;
+    int rows, cols;
+    long frames, rawBytes, storedBytes;
+    std::vector<cell_t> previous, current;
+    std::vector<uint8_t> packed;
+};
+
+// Lettura sequenziale di una registrazione
+class Player {
+public:
+    Player() : file(NULL), gen(-1), bad(false) {}
+    ~Player() { if(file) fclose(file); }
+
+    // false se il file non esiste o non è una registrazione
+    bool open(const char *path)
+    {
+        file = fopen(path, "rb");
+        if(file == NULL)
+            return false;
+
+        if(fread(&h, sizeof(h), 1, file) != 1 || memcmp(h.magic, RECORD_MAGIC, 8) != 0 ||
+           h.version != RECORD_VERSION || h.rows == 0 || h.cols == 0)
+            return false;
+
+        grid.assign((size_t)h.rows * h.cols, 0);
+        delta.resize(grid.size());
+        return true;
+    }
+
+    const RecordHeader &header() const { return h; }
+
+    // Legge il frame successivo; false alla fine del file o se il frame non è valido
+    bool next()
+    {
+        RecordFrame f;
+        size_t n = fread(&f, 1, sizeof(f), file);
+        if(n != sizeof(f)) {
+            bad = n != 0;
+            return false;
+        }
+
+        packed.resize(f.bytes);
+        if(fread(packed.data(), 1, f.bytes, file) != f.bytes)
+            return setGen(0, false);
+
+        if(f.key)
+            return setGen(f.gen, rleUnpack(packed.data(), f.bytes, grid.data(), grid.size()));
+
+        if(!rleUnpack(packed.data(), f.bytes, delta.data(), delta.size()))
+            return setGen(0, false);
+        for(size_t i = 0; i < grid.size(); ++i)
+            grid[i] ^= delta[i];
+        return setGen(f.gen, true);
+    }
+
+    // Torna al primo frame
+    void rewind()
+    {
+        fseek(file, sizeof(RecordHeader), SEEK_SET);
+        gen = -1;
+        bad = false;
+    }
+
+    // true se la lettura si è fermata su un frame troncato o non valido (e non alla fine del file)
+    bool damaged() const { return bad; }
+
+    const cell_t *frame() const { return grid.data(); }
+    int generation() const { return gen; }
+
+private:
+    FILE *file;
+    RecordHeader h;
+    int gen;
+    bool bad;
+    std::vector<cell_t> grid, delta;
+    std::vector<uint8_t> packed;
+
+    bool setGen(uint32_t g, bool ok)
+    {
+        if(ok)
+            gen = (int)g;
+        else
+            bad = true;
+        return ok;
+    }
+};
+
+#endif
@@ -0,0 +1,130 @@
+// Disegno della griglia tramite texture, condiviso dalla versione seriale e da quella MPI.
+//
+// Ogni frame la griglia viene convertita in pixel in una sola passata, con una tabella di colori
+// indicizzata dallo stato (nessun confronto per cella), dentro una bitmap bloccata in scrittura;
+// la bitmap viene poi scalata alla finestra con un'unica chiamata di disegno.
+// Se la griglia ha più celle che pixel nella finestra, la bitmap viene sottocampionata:
+// ogni pixel mostra una cella ogni factor righe/colonne, quindi il costo di un frame dipende
+// dalla dimensione della finestra e non dal numero di celle.
+// drawView() disegna invece l'immagine già ridotta di un viewport (viewport.h), ingrandita a tutta
+// la finestra.
+
+#ifndef PARASITES_RENDER_H
+#define PARASITES_RENDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <allegro5/allegro.h>
+#include "kernel.h"
+#include "viewport.h"
+
+// Dimensione massima della finestra: le griglie più grandi vengono rimpicciolite
+#define RENDER_MAX_WIDTH 1600
+#define RENDER_MAX_HEIGHT 1000
+
+// Colore in ALLEGRO_PIXEL_FORMAT_ABGR_8888 (parola a 32 bit: alfa, blu, verde, rosso)
+inline uint32_t packColor(uint8_t r, uint8_t g, uint8_t b)
+{
+    return 0xFF000000u | (uint32_t)b << 16 | (uint32_t)g << 8 | r;
+}
+
+// Dimensione della finestra: cellSize pixel per cella, ridotta (mantenendo le proporzioni)
+// se supera RENDER_MAX_WIDTH x RENDER_MAX_HEIGHT
+inline void windowSize(int rows, int cols, int cellSize, int *width, int *height)
+{
+    double scale = cellSize;
+    if(cols * scale > RENDER_MAX_WIDTH)
+        scale = (double)RENDER_MAX_WIDTH / cols;
+    if(rows * scale > RENDER_MAX_HEIGHT)
+        scale = (double)RENDER_MAX_HEIGHT / rows;
+
+    *width = cols * scale >= 1 ? (int)(cols * scale) : 1;
+    *height = rows * scale >= 1 ? (int)(rows * scale) : 1;
+}
+
+class FrameRenderer {
+public:
+    // Da chiamare con il display (width x height pixel) già creato, nel thread che lo usa
+    FrameRenderer(int rows, int cols, int width, int height) : rows(rows), cols(cols), width(width), height(height)
+    {
+        factor = 1;
+        while(cols > width * factor || rows > height * factor)
+            factor++;
+        bitmapWidth = (cols + factor - 1) / factor;
+        bitmapHeight = (rows + factor - 1) / factor;
+        bitmap = al_create_bitmap(bitmapWidth, bitmapHeight);
+        viewBitmap = NULL;
+
+        for(int s = 0; s < 256; ++s)
+            palette[s] = packColor(0, 0, 0);
+        palette[EMPTY] = packColor(0, 0, 0);
+        palette[PARASITE] = packColor(255, 0, 0);
+        palette[SEEDED_GRASS] = packColor(34, 139, 34);
+        palette[GROWING_GRASS] = packColor(50, 205, 50);
+        palette[GROWN_GRASS] = packColor(0, 255, 0);
+    }
+
+    ~FrameRenderer()
+    {
+        al_destroy_bitmap(bitmap);
+        if(viewBitmap)
+            al_destroy_bitmap(viewBitmap);
+    }
+
+    bool valid() const { return bitmap != NULL; }
+
+    // Celle per pixel lungo ciascun lato (1 = nessun sottocampionamento)
+    int downsampling() const { return factor; }
+
+    // Disegna la griglia nel backbuffer: grid punta alla cella (0,0) e pitch è la distanza
+    // in celle tra due righe consecutive. Il chiamante fa poi al_flip_display()
+    void draw(const cell_t *grid, size_t pitch)
+    {
+        ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_WRITEONLY);
+        if(region == NULL)
+            return;
+
+        for(int y = 0; y < bitmapHeight; ++y) {
+            const cell_t *row = grid + (size_t)y * factor * pitch;
+            uint32_t *pixels = (uint32_t*)((uint8_t*)region->data + (ptrdiff_t)y * region->pitch);
+
+            if(factor == 1)
+                for(int x = 0; x < bitmapWidth; ++x)
+                    pixels[x] = palette[row[x]];
+            else
+                for(int x = 0; x < bitmapWidth; ++x)
+                    pixels[x] = palette[row[(size_t)x * factor]];
+        }
+        al_unlock_bitmap(bitmap);
+
+        al_draw_scaled_bitmap(bitmap, 0, 0, bitmapWidth, bitmapHeight, 0, 0, width, height, 0);
+    }
+
+    // Disegna nel backbuffer l'immagine ridotta di un viewport: rows x cols stati compatti (al più
+    // width x height, vedi clampView()), ingranditi a tutta la finestra. La bitmap viene creata al primo uso
+    void drawView(const cell_t *image, int rows, int cols)
+    {
+        if(viewBitmap == NULL && (viewBitmap = al_create_bitmap(width, height)) == NULL)
+            return;
+        ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(viewBitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_WRITEONLY);
+        if(region == NULL)
+            return;
+
+        for(int y = 0; y < rows; ++y) {
+            const cell_t *row = image + (size_t)y * cols;
+            uint32_t *pixels = (uint32_t*)((uint8_t*)region->data + (ptrdiff_t)y * region->pitch);
+            for(int x = 0; x < cols; ++x)
+                pixels[x] = palette[row[x]];
+        }
+        al_unlock_bitmap(viewBitmap);
+
+        al_draw_scaled_bitmap(viewBitmap, 0, 0, cols, rows, 0, 0, width, height, 0);
+    }
+
+private:
+    int rows, cols, width, height, factor, bitmapWidth, bitmapHeight;
+    ALLEGRO_BITMAP *bitmap, *viewBitmap;
+    uint32_t palette[256];
+};
+
+#endif
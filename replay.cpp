@@ -0,0 +1,211 @@
+/*
+---------- RIPRODUZIONE DI UNA REGISTRAZIONE ----------
+Mostra una registrazione scritta con --record da parasites.cpp o parasites_serial.cpp,
+con gli stessi colori della finestra della simulazione (render.h).
+
+COMANDO PER COMPILARE ED ESEGUIRE IL CODICE:
+> g++ replay.cpp -o replay -lallegro
+> ./replay run.rec --fps 30
+
+Tasti: SPAZIO pausa/ripresa, FRECCIA DESTRA una generazione avanti (in pausa),
+FRECCIA SU/GIU' velocità doppia/dimezzata, HOME ricomincia dall'inizio.
+Con --info stampa solo il riepilogo della registrazione (senza display).
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <allegro5/allegro.h>
+#include "kernel.h"
+#include "render.h"
+#include "record.h"
+
+#define TITLE "Parasites - replay"
+
+const char *path;
+int SIZE_CELL = 4;
+double fps = 30;
+bool infoOnly = false;
+
+Player player;
+
+// Allegro graphics
+ALLEGRO_DISPLAY *display;
+ALLEGRO_EVENT_QUEUE *queue;
+FrameRenderer *renderer;
+
+inline int parseArgs(int argc, char *argv[]);
+inline int printInfo();
+inline int init_allegro();
+inline void finalize_allegro();
+inline void print();
+
+
+int main(int argc, char *argv[])
+{
+    if(parseArgs(argc, argv) == -1)
+        return -1;
+
+    if(!player.open(path)) {
+        printf("Errore: %s non è una registrazione valida...\n", path);
+        return -1;
+    }
+
+    if(infoOnly)
+        return printInfo();
+
+    if(init_allegro() == -1)
+        return -1;
+
+    bool paused = false, stop = false, step = false, ended = false;
+    double last = al_get_time();
+
+    if(player.next())
+        print();
+
+    while(!stop) {
+        ALLEGRO_EVENT event;
+        while(al_get_next_event(queue, &event)) {
+            if(event.type == ALLEGRO_EVENT_DISPLAY_CLOSE)
+                stop = true;
+            else if(event.type == ALLEGRO_EVENT_KEY_DOWN) {
+                switch(event.keyboard.keycode) {
+                    case ALLEGRO_KEY_SPACE: paused = !paused; break;
+                    case ALLEGRO_KEY_RIGHT: step = true; break;
+                    case ALLEGRO_KEY_UP: fps *= 2; break;
+                    case ALLEGRO_KEY_DOWN: fps = fps / 2 >= 0.5 ? fps / 2 : 0.5; break;
+                    case ALLEGRO_KEY_HOME:
+                        player.rewind();
+                        ended = false;
+                        step = true;
+                        break;
+                    case ALLEGRO_KEY_ESCAPE: stop = true; break;
+                    default: break;
+                }
+            }
+        }
+
+        // In pausa (o alla fine) si avanza solo con FRECCIA DESTRA, altrimenti fps frame al secondo
+        double now = al_get_time();
+        if(!ended && (step || (!paused && now - last >= 1.0 / fps))) {
+            if(player.next())
+                print();
+            else
+                ended = true;
+            last = now;
+            step = false;
+        }
+        else al_rest(1.0 / 240.0);
+    }
+
+    finalize_allegro();
+    return 0;
+}
+
+// Lettura delle opzioni da riga di comando; restituisce -1 se il programma deve terminare
+inline int parseArgs(int argc, char *argv[])
+{
+    static struct option longOptions[] = {
+        {"fps",       required_argument, 0, 'f'},
+        {"cell-size", required_argument, 0, 'z'},
+        {"info",      no_argument,       0, 'i'},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while((opt = getopt_long(argc, argv, "f:z:ih", longOptions, NULL)) != -1) {
+        switch(opt) {
+            case 'f': fps = atof(optarg); break;
+            case 'z': SIZE_CELL = atoi(optarg); break;
+            case 'i': infoOnly = true; break;
+
+            default:
+                printf("Uso: %s FILE [--fps N] [--cell-size PX] [--info]\n", argv[0]);
+                return -1;
+        }
+    }
+
+    if(optind != argc - 1 || fps <= 0 || SIZE_CELL <= 0) {
+        printf("Uso: %s FILE [--fps N] [--cell-size PX] [--info]\n", argv[0]);
+        return -1;
+    }
+    path = argv[optind];
+    return 0;
+}
+
+// Riepilogo: dimensioni, generazioni registrate e rapporto di compressione. Tutti i frame
+// vengono decompressi, quindi una registrazione danneggiata viene segnalata
+inline int printInfo()
+{
+    const RecordHeader &h = player.header();
+    FILE *f = fopen(path, "rb");
+    fseek(f, 0, SEEK_END);
+    long bytes = ftell(f);
+    fclose(f);
+
+    long frames = 0;
+    int first = -1;
+    while(player.next()) {
+        if(frames++ == 0)
+            first = player.generation();
+    }
+
+    double raw = (double)frames * h.rows * h.cols;
+    printf("RECORD rows=%u cols=%u seed=%u frames=%ld first_gen=%d last_gen=%d bytes=%ld ratio=%.1f\n",
+           h.rows, h.cols, h.seed, frames, first, player.generation(), bytes, bytes > 0 ? raw / bytes : 0.0);
+    if(player.damaged()) {
+        printf("Errore: registrazione troncata o danneggiata dopo la generazione %d...\n", player.generation());
+        return -1;
+    }
+    return 0;
+}
+
+inline int init_allegro()
+{
+    if(!al_init()) {
+        printf("Errore: impossibile inizializzare allegro...\n");
+        return -1;
+    }
+
+    const RecordHeader &h = player.header();
+    int width, height;
+    windowSize(h.rows, h.cols, SIZE_CELL, &width, &height);
+    display = al_create_display(width, height);
+    if(!display) {
+        printf("Errore: impossibile creare una finestra %dx%d...\n", width, height);
+        return -1;
+    }
+    queue = al_create_event_queue();
+    renderer = new FrameRenderer(h.rows, h.cols, width, height);
+    if(!renderer->valid()) {
+        printf("Errore: impossibile creare la bitmap dei frame...\n");
+        return -1;
+    }
+
+    al_install_keyboard();
+    al_register_event_source(queue, al_get_display_event_source(display));
+    al_register_event_source(queue, al_get_keyboard_event_source());
+    al_set_window_title(display, TITLE);
+    return 0;
+}
+
+// Disegna il frame corrente; il titolo della finestra mostra la generazione
+inline void print()
+{
+    char title[128];
+    snprintf(title, sizeof(title), "%s - GEN %d", TITLE, player.generation());
+    al_set_window_title(display, title);
+
+    renderer->draw(player.frame(), player.header().cols);
+    al_flip_display();
+}
+
+inline void finalize_allegro()
+{
+    delete renderer;
+    al_destroy_event_queue(queue);
+    al_destroy_display(display);
+}
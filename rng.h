@@ -0,0 +1,121 @@
+// Generatore di numeri casuali basato su contatore (Philox4x32-10, Salmon et al., SC'11).
+//
+// Il numero casuale di una cella è una funzione pura di (seed, GEN, riga globale, colonna globale):
+// non c'è uno stato da far avanzare, quindi il risultato non dipende dall'ordine in cui le celle
+// vengono visitate, dal numero di processi o dal numero di thread. La versione AVX2 calcola
+// 8 valori (8 colonne consecutive) alla volta.
+
+#ifndef PARASITES_RNG_H
+#define PARASITES_RNG_H
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+// Seconda parola della chiave, fissa: distingue questo flusso da altri usi di Philox con lo stesso seed
+#define PHILOX_KEY1 0x50415241u
+
+// Soglia per un evento con probabilità num/den: u < soglia equivale a estrarre
+// un numero tra 1 e den e controllare che sia <= num
+constexpr uint32_t oddsThreshold(uint32_t num, uint32_t den)
+{
+    uint64_t t = (((uint64_t)num << 32) + den - 1) / den;
+    return t > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)t;
+}
+
+inline uint32_t mulhilo(uint32_t a, uint32_t b, uint32_t *hi)
+{
+    uint64_t p = (uint64_t)a * b;
+    *hi = (uint32_t)(p >> 32);
+    return (uint32_t)p;
+}
+
+// Prima parola di Philox4x32-10 con contatore (col, row, gen, 0) e chiave (seed, PHILOX_KEY1)
+inline uint32_t philox(uint32_t seed, uint32_t gen, uint32_t row, uint32_t col)
+{
+    uint32_t c0 = col, c1 = row, c2 = gen, c3 = 0, k0 = seed, k1 = PHILOX_KEY1;
+
+    for(int i = 0; i < PHILOX_ROUNDS; ++i) {
+        uint32_t hi0, hi1;
+        uint32_t lo0 = mulhilo(PHILOX_M0, c0, &hi0);
+        uint32_t lo1 = mulhilo(PHILOX_M1, c2, &hi1);
+
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    return c0;
+}
+
+// Prodotto 32x32 -> 64 bit sulle 8 lane: restituisce la parte bassa e in *hi la parte alta
+__attribute__((target("avx2")))
+inline __m256i mulhilo8(__m256i m, __m256i a, __m256i *hi)
+{
+    __m256i even = _mm256_mul_epu32(m, a);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(m, 32), _mm256_srli_epi64(a, 32));
+
+    *hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+    return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
+
+// Stesso risultato di philox() per le colonne col, col+1, ..., col+7
+__attribute__((target("avx2")))
+inline __m256i philox8(uint32_t seed, uint32_t gen, uint32_t row, uint32_t col)
+{
+    const __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0), m1 = _mm256_set1_epi32((int)PHILOX_M1);
+    __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((int)col), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i c1 = _mm256_set1_epi32((int)row), c2 = _mm256_set1_epi32((int)gen), c3 = _mm256_setzero_si256();
+    uint32_t k0 = seed, k1 = PHILOX_KEY1;
+
+    for(int i = 0; i < PHILOX_ROUNDS; ++i) {
+        __m256i hi0, hi1;
+        __m256i lo0 = mulhilo8(m0, c0, &hi0);
+        __m256i lo1 = mulhilo8(m1, c2, &hi1);
+
+        c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32((int)k0));
+        c1 = lo1;
+        c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32((int)k1));
+        c3 = lo0;
+
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    return c0;
+}
+
+// Numeri casuali delle 32 colonne consecutive a partire da col, in 4 registri da 8
+__attribute__((target("avx2")))
+inline void philox32(uint32_t seed, uint32_t gen, uint32_t row, uint32_t col, __m256i u[4])
+{
+    for(int i = 0; i < 4; ++i)
+        u[i] = philox8(seed, gen, row, col + 8*i);
+}
+
+// Maschera a byte (0xFF dove l'evento avviene) delle 32 colonne: u < threshold,
+// con confronto senza segno tramite lo scambio del bit di segno
+__attribute__((target("avx2")))
+inline __m256i belowThreshold32(const __m256i u[4], uint32_t threshold)
+{
+    const __m256i sign = _mm256_set1_epi32((int)0x80000000u);
+    const __m256i t = _mm256_set1_epi32((int)(threshold ^ 0x80000000u));
+    __m256i m[4];
+
+    for(int i = 0; i < 4; ++i)
+        m[i] = _mm256_cmpgt_epi32(t, _mm256_xor_si256(u[i], sign));
+
+    // Da 4x8 maschere a 32 bit a 32 maschere a 8 bit: packs lavora per metà registro,
+    // la permutazione finale rimette le colonne in ordine
+    __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(m[0], m[1]), _mm256_packs_epi32(m[2], m[3]));
+    return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+#endif
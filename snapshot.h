@@ -0,0 +1,114 @@
+// Anello di istantanee della griglia tra il ciclo di simulazione (produttore) e il thread che
+// disegna (consumatore).
+//
+// Il produttore non si blocca mai: acquire() restituisce sempre un'istantanea libera, cioè né quella
+// che il consumatore sta disegnando né l'ultima pubblicata. Se il consumatore è più lento, un'istantanea
+// pubblicata e non ancora presa viene sostituita dalla successiva (frame scartato), quindi il
+// consumatore disegna sempre la più recente disponibile. Bastano 3 istantanee.
+// Con ogni istantanea viaggia il viewport (viewport.h) di cui è l'immagine, se è ridotta.
+
+#ifndef PARASITES_SNAPSHOT_H
+#define PARASITES_SNAPSHOT_H
+
+#include <stddef.h>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include "kernel.h"
+#include "viewport.h"
+
+#define SNAPSHOT_SLOTS 3
+
+class SnapshotRing {
+public:
+    SnapshotRing(size_t cells, int slots = SNAPSHOT_SLOTS) : frames(slots, std::vector<cell_t>(cells)),
+                                                            gens(slots, 0), views(slots), writing(-1), pending(-1),
+                                                            reading(-1), closing(false), shownCount(0), droppedCount(0)
+    {
+    }
+
+    // Produttore: istantanea in cui scrivere la prossima generazione
+    cell_t *acquire()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for(int i = 0; i < (int)frames.size(); ++i)
+            if(i != reading && i != pending) {
+                writing = i;
+                break;
+            }
+        return frames[writing].data();
+    }
+
+    // Produttore: l'istantanea appena scritta diventa la più recente
+    void publish(int gen, const Viewport &view)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if(pending >= 0)
+                droppedCount++;
+            pending = writing;
+            gens[pending] = gen;
+            views[pending] = view;
+            writing = -1;
+        }
+        ready.notify_one();
+    }
+
+    // Consumatore: attende al più timeout secondi un'istantanea nuova e la restituisce
+    // (con la sua generazione in *gen e il suo viewport in *view); NULL se non ne arrivano o se
+    // l'anello è stato chiuso. L'istantanea resta valida fino alla chiamata successiva
+    const cell_t *take(int *gen, Viewport *view, double timeout)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        ready.wait_for(guard, std::chrono::duration<double>(timeout), [&]{ return pending >= 0 || closing; });
+        if(pending < 0 || closing)
+            return NULL;
+
+        reading = pending;
+        pending = -1;
+        shownCount++;
+        *gen = gens[reading];
+        *view = views[reading];
+        return frames[reading].data();
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closing = true;
+        }
+        ready.notify_all();
+    }
+
+    bool closed()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return closing;
+    }
+
+    long shown()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return shownCount;
+    }
+
+    long dropped()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return droppedCount;
+    }
+
+private:
+    std::vector<std::vector<cell_t> > frames;
+    std::vector<int> gens;
+    std::vector<Viewport> views;
+    int writing, pending, reading;
+    bool closing;
+    long shownCount, droppedCount;
+    std::mutex lock;
+    std::condition_variable ready;
+};
+
+#endif
@@ -0,0 +1,81 @@
+// Statistiche di popolazione per generazione, condivise dalla versione seriale e da quella MPI.
+//
+// Il kernel conta le transizioni di stato delle celle che calcola (kernel.h); la popolazione di
+// ogni stato si ottiene contando la griglia una sola volta all'inizio e applicando poi le
+// transizioni di ogni generazione. Le celle non calcolate (tile non attivi) non cambiano, quindi
+// non servono né un gather né una scansione della griglia ad ogni generazione.
+//
+// Una riga di statistiche è fatta di STATS_FIELDS contatori: prima la popolazione di ogni stato
+// (indicizzata da states), poi le transizioni della generazione (indicizzate da transitions).
+// Le righe di processi diversi si sommano campo per campo (MPI_SUM).
+
+#ifndef PARASITES_STATS_H
+#define PARASITES_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "kernel.h"
+
+#define STATS_FIELDS (STATE_COUNT + TRANSITION_COUNT)
+
+// Conta gli stati di n celle, aggiungendoli a population
+inline void countStates(const cell_t *cells, size_t n, uint64_t *population)
+{
+    for(size_t i = 0; i < n; ++i)
+        population[cells[i]]++;
+}
+
+// Riga della generazione appena calcolata: la popolazione precedente (nei primi STATE_COUNT campi
+// di row) viene aggiornata con le transizioni t, che vengono copiate in coda
+inline void applyTransitions(uint64_t *row, const uint64_t *t)
+{
+    row[EMPTY] += t[DEATH] - t[SEEDING];
+    row[SEEDED_GRASS] += t[SEEDING] - t[SPROUTING];
+    row[GROWING_GRASS] += t[SPROUTING] - t[RIPENING];
+    row[GROWN_GRASS] += t[RIPENING] - t[INFECTION];
+    row[PARASITE] += t[INFECTION] - t[DEATH];
+    memcpy(row + STATE_COUNT, t, TRANSITION_COUNT * sizeof(uint64_t));
+}
+
+// Serie temporale in formato CSV, una riga per generazione
+class StatsWriter {
+public:
+    StatsWriter() : file(NULL), rows(0) {}
+    ~StatsWriter() { close(); }
+
+    bool open(const char *path)
+    {
+        file = fopen(path, "w");
+        if(file == NULL)
+            return false;
+        fprintf(file, "gen,empty,parasite,seeded_grass,growing_grass,grown_grass,"
+                      "seeded,sprouted,ripened,infected,died\n");
+        return true;
+    }
+
+    void write(int gen, const uint64_t *row)
+    {
+        fprintf(file, "%d", gen);
+        for(int f = 0; f < STATS_FIELDS; ++f)
+            fprintf(file, ",%llu", (unsigned long long)row[f]);
+        fputc('\n', file);
+        rows++;
+    }
+
+    void close()
+    {
+        if(file)
+            fclose(file);
+        file = NULL;
+    }
+
+    bool isOpen() const { return file != NULL; }
+    long rowCount() const { return rows; }
+
+private:
+    FILE *file;
+    long rows;
+};
+
+#endif
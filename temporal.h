@@ -0,0 +1,142 @@
+// Blocking temporale: più generazioni per ogni passata sulla memoria, condiviso dalla versione
+// seriale e da quella MPI.
+//
+// Una passata legge la generazione g dalla matrice di lettura e scrive la generazione g+steps nella
+// matrice di scrittura; le generazioni intermedie vivono solo in piccoli buffer circolari di 3 righe
+// per generazione (pipeline a fronte d'onda: la generazione g+k calcola la riga x quando la
+// generazione g+k-1 ha già calcolato la riga x+1). Con steps = 2 una passata fonde una generazione
+// dell'erba e una dei parassiti.
+//
+// Per restare nella cache L2 le colonne vengono divise in strisce indipendenti (trapezi): per
+// calcolare le colonne [left, right] della generazione finale, la generazione g+k calcola anche
+// steps-k colonne in più per lato, ricalcolate anche dalla striscia vicina. Ogni cella viene
+// calcolata con lo stesso kernel e lo stesso contatore casuale della versione generazione per
+// generazione, quindi il risultato è identico.
+
+#ifndef PARASITES_TEMPORAL_H
+#define PARASITES_TEMPORAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include "kernel.h"
+
+// Numero massimo di generazioni per passata
+#define FUSED_MAX 16
+
+// Celle calcolate per una generazione (estremi inclusi). Le regioni devono restringersi:
+// le celle lette dalla generazione k+1 intorno alla regione k+1 stanno nella regione k, oppure
+// fuori da tutte le regioni, dove valgono EMPTY (la cornice della griglia). Con bordi periodici
+// le regioni escono dalla griglia e la cornice letta dalla prima generazione contiene il lato opposto
+struct FusedRegion {
+    int top, bottom, left, right;
+};
+
+// Una passata su una griglia memorizzata per righe: la cella (r, c) della matrice è in
+// base[r*stride + c], anche con r e c negativi (nella cornice)
+struct FusedPlan {
+    int steps;
+    FusedRegion region[FUSED_MAX + 1];   // region[k]: generazione g+k, per k da 1 a steps
+    size_t stride;
+    int colOrigin;                       // posizione della colonna 0 all'interno di una riga memorizzata
+    int gen;                             // generazione g
+    int rowOffset, colOffset;            // la cella (r, c) è la cella globale (rowOffset+r, colOffset+c)
+    uint32_t seed;
+    int rows, cols;                      // con bordi periodici, dimensioni della griglia globale (0 = chiusi)
+    FusedRegion count;                   // celle di cui contare le transizioni (quelle possedute)
+};
+
+// Buffer di lavoro di un thread: 3 righe per ogni generazione intermedia, una riga di EMPTY
+// e le somme del kernel di riga. Se counts non è NULL, le transizioni della generazione g+k
+// vengono contate in counts[(k-1)*TRANSITION_COUNT ...]
+struct FusedScratch {
+    cell_t *rows;
+    cell_t *zero;
+    RowScratch row;
+    uint64_t *counts;
+};
+
+// Byte da allocare (azzerati) per un FusedScratch con righe memorizzate di stride celle
+inline size_t fusedScratchSize(size_t stride)
+{
+    return (3 * (FUSED_MAX - 1) + 1) * stride + scratchSize((int)stride);
+}
+
+inline FusedScratch makeFusedScratch(cell_t *mem, size_t stride)
+{
+    FusedScratch fs;
+    fs.rows = mem;
+    fs.zero = mem + 3 * (FUSED_MAX - 1) * stride;
+    fs.row = makeScratch(fs.zero + stride, (int)stride);
+    fs.counts = NULL;
+    return fs;
+}
+
+// Larghezza delle strisce: il buffer circolare e le righe lette e scritte devono stare in metà
+// della cache L2; con più thread, almeno una striscia per thread
+inline int fusedStripWidth(int cols, int steps, int threads)
+{
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if(l2 <= 0)
+        l2 = 1 << 20;
+
+    long width = l2 / 2 / (3 * steps + 4) - 2 * steps;
+    if(width < 64)
+        width = 64;
+    if(width > (cols + threads - 1) / threads)
+        width = (cols + threads - 1) / threads;
+    return width > 0 ? (int)width : 1;
+}
+
+// Riga y della generazione g+k per il calcolo della generazione successiva (puntatore alla colonna 0)
+inline const cell_t *fusedRow(const cell_t *in, const FusedPlan &p, int k, int y, FusedScratch &fs)
+{
+    if(k == 0)
+        return in + (ptrdiff_t)y * p.stride;
+    if(y < p.region[k].top || y > p.region[k].bottom)
+        return fs.zero + p.colOrigin;
+    return fs.rows + ((k-1) * 3 + ((y % 3) + 3) % 3) * p.stride + p.colOrigin;
+}
+
+// Passata sulla striscia di colonne [left, right] della generazione finale. Le colonne calcolate
+// anche dalle strisce vicine e la cornice non vengono contate: ogni cella di p.count viene contata
+// una sola volta per generazione
+inline void fusedStrip(RowKernel kernel, const cell_t *in, cell_t *out, const FusedPlan &p,
+                       int left, int right, FusedScratch &fs)
+{
+    int countLeft = left > p.count.left ? left : p.count.left;
+    int countRight = right < p.count.right ? right : p.count.right;
+
+    int T = p.steps, lo[FUSED_MAX + 1], hi[FUSED_MAX + 1];
+
+    for(int k = 1; k <= T; ++k) {
+        lo[k] = left - (T-k) > p.region[k].left ? left - (T-k) : p.region[k].left;
+        hi[k] = right + (T-k) < p.region[k].right ? right + (T-k) : p.region[k].right;
+    }
+
+    // Al passo r la generazione g+k calcola la riga r - 2(k-1), dalla più avanzata alla meno
+    // avanzata: così una riga del buffer circolare viene sovrascritta solo dopo l'ultimo uso
+    for(int r = p.region[1].top; r <= p.region[T].bottom + 2*(T-1); ++r) {
+        for(int k = T; k >= 1; --k) {
+            int x = r - 2*(k-1);
+            if(x < p.region[k].top || x > p.region[k].bottom || lo[k] > hi[k])
+                continue;
+
+            cell_t *dst = k == T ? out + (ptrdiff_t)x * p.stride
+                                 : fs.rows + ((k-1) * 3 + ((x % 3) + 3) % 3) * p.stride + p.colOrigin;
+            RowContext ctx = {p.gen + k-1, p.rowOffset + x, p.colOffset + lo[k], p.seed, p.rows, p.cols};
+            if(fs.counts) {
+                bool counted = x >= p.count.top && x <= p.count.bottom;
+                fs.row.counts = fs.counts + (k-1) * TRANSITION_COUNT;
+                fs.row.countFrom = counted ? countLeft - lo[k] : 0;
+                fs.row.countTo = counted ? countRight - lo[k] + 1 : 0;
+            }
+
+            periodicRow(kernel, fusedRow(in, p, k-1, x-1, fs) + lo[k], fusedRow(in, p, k-1, x, fs) + lo[k],
+                        fusedRow(in, p, k-1, x+1, fs) + lo[k], dst + lo[k], hi[k] - lo[k] + 1, ctx, fs.row);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,136 @@
+// Viewport della grafica: rettangolo visibile della griglia globale e sua immagine ridotta.
+//
+// Il viewport (spostato e ingrandito dall'utente con mouse e tastiera) viene disegnato in una
+// finestra di width x height pixel: ogni pixel dell'immagine ridotta rappresenta un blocco di
+// scale x scale celle e mostra lo stato più frequente del blocco, quindi l'immagine non ha mai più
+// pixel della finestra, qualunque sia la dimensione della griglia. Quando il viewport ha meno celle
+// che pixel (scale = 1) l'immagine viene ingrandita dal disegno.
+//
+// La riduzione è separabile per zone: chi possiede le righe [rowOffset, rowOffset+rows) e le
+// colonne [colOffset, colOffset+cols) calcola i pixel la cui prima cella cade nella sua zona
+// (viewSpan), usando le sole celle della zona: così in parasites.cpp ogni processo riduce il suo
+// blocco e al processo 0 arrivano solo i pixel.
+
+#ifndef PARASITES_VIEWPORT_H
+#define PARASITES_VIEWPORT_H
+
+#include <stddef.h>
+#include "kernel.h"
+
+// Ingrandimento massimo: pixel della finestra per cella
+#define VIEW_MAX_ZOOM 32
+
+struct Viewport {
+    int top, left, rows, cols;   // celle visibili: righe [top, top+rows) e colonne [left, left+cols)
+    int scale;                   // celle per pixel dell'immagine ridotta lungo ciascun lato
+};
+
+// Dimensioni dell'immagine ridotta
+inline int viewRows(const Viewport &v) { return (v.rows + v.scale - 1) / v.scale; }
+inline int viewCols(const Viewport &v) { return (v.cols + v.scale - 1) / v.scale; }
+
+// Riporta il viewport dentro la griglia (almeno una cella) e sceglie la scala minima per cui
+// l'immagine ridotta sta in width x height pixel
+inline void clampView(Viewport &v, int gridRows, int gridCols, int width, int height)
+{
+    v.rows = v.rows < 1 ? 1 : v.rows > gridRows ? gridRows : v.rows;
+    v.cols = v.cols < 1 ? 1 : v.cols > gridCols ? gridCols : v.cols;
+    v.top = v.top < 0 ? 0 : v.top > gridRows - v.rows ? gridRows - v.rows : v.top;
+    v.left = v.left < 0 ? 0 : v.left > gridCols - v.cols ? gridCols - v.cols : v.left;
+
+    v.scale = 1;
+    while(v.cols > width * v.scale || v.rows > height * v.scale)
+        v.scale++;
+}
+
+// Viewport sull'intera griglia
+inline Viewport fullView(int gridRows, int gridCols, int width, int height)
+{
+    Viewport v = {0, 0, gridRows, gridCols, 1};
+    clampView(v, gridRows, gridCols, width, height);
+    return v;
+}
+
+// Ingrandimento di factor (< 1 avvicina, > 1 allontana) intorno al punto della finestra (x, y):
+// la cella sotto il punto resta sotto il punto
+inline Viewport zoomView(const Viewport &v, double factor, int x, int y, int gridRows, int gridCols, int width, int height)
+{
+    double cellsPerPixel = (double)v.cols / width > (double)v.rows / height ? (double)v.cols / width : (double)v.rows / height;
+    double row = v.top + y * cellsPerPixel, col = v.left + x * cellsPerPixel;
+    cellsPerPixel *= factor;
+    if(cellsPerPixel < 1.0 / VIEW_MAX_ZOOM)
+        cellsPerPixel = 1.0 / VIEW_MAX_ZOOM;
+
+    Viewport z;
+    z.rows = (int)(height * cellsPerPixel + 0.5);
+    z.cols = (int)(width * cellsPerPixel + 0.5);
+    z.top = (int)(row - y * cellsPerPixel + 0.5);
+    z.left = (int)(col - x * cellsPerPixel + 0.5);
+    clampView(z, gridRows, gridCols, width, height);
+    return z;
+}
+
+// Spostamento di rows righe e cols colonne
+inline Viewport panView(const Viewport &v, int rows, int cols, int gridRows, int gridCols, int width, int height)
+{
+    Viewport p = v;
+    p.top += rows;
+    p.left += cols;
+    clampView(p, gridRows, gridCols, width, height);
+    return p;
+}
+
+// Pixel [*first, *last) la cui prima cella sta tra start e end (esclusa) lungo un lato del viewport
+// che inizia da viewStart ed è lungo viewLength celle
+inline void viewSpan(int viewStart, int viewLength, int scale, int start, int end, int *first, int *last)
+{
+    int pixels = (viewLength + scale - 1) / scale;
+    int a = start <= viewStart ? 0 : (start - viewStart + scale - 1) / scale;
+    int b = end <= viewStart ? 0 : (end - viewStart + scale - 1) / scale;
+    *first = a < pixels ? a : pixels;
+    *last = b < pixels ? b : pixels;
+    if(*last < *first)
+        *last = *first;
+}
+
+// Stato più frequente delle rows x cols celle da cells (a parità, il primo nell'ordine degli stati)
+inline cell_t dominantState(const cell_t *cells, size_t pitch, int rows, int cols)
+{
+    if(rows == 1 && cols == 1)
+        return cells[0];
+
+    int counts[STATE_COUNT] = {0};
+    for(int r = 0; r < rows; ++r)
+        for(int c = 0; c < cols; ++c)
+            counts[cells[(size_t)r * pitch + c]]++;
+
+    int best = 0;
+    for(int s = 1; s < STATE_COUNT; ++s)
+        best = counts[s] > counts[best] ? s : best;
+    return (cell_t)best;
+}
+
+// Immagine ridotta della zona rows x cols a partire dalla cella globale (rowOffset, colOffset), di
+// cui zone è la prima cella: i pixel [py0, py1) x [px0, px1) vengono scritti compatti in out e
+// restituiti in span = {py0, py1, px0, px1}. Ogni pixel usa le sole celle della zona
+inline void reduceZone(const cell_t *zone, size_t pitch, int rowOffset, int colOffset, int rows, int cols,
+                       const Viewport &v, cell_t *out, int span[4])
+{
+    viewSpan(v.top, v.rows, v.scale, rowOffset, rowOffset + rows, &span[0], &span[1]);
+    viewSpan(v.left, v.cols, v.scale, colOffset, colOffset + cols, &span[2], &span[3]);
+
+    int rowEnd = v.top + v.rows < rowOffset + rows ? v.top + v.rows : rowOffset + rows;
+    int colEnd = v.left + v.cols < colOffset + cols ? v.left + v.cols : colOffset + cols;
+
+    for(int py = span[0]; py < span[1]; ++py) {
+        int r0 = v.top + py * v.scale;
+        int r1 = r0 + v.scale < rowEnd ? r0 + v.scale : rowEnd;
+        for(int px = span[2]; px < span[3]; ++px) {
+            int c0 = v.left + px * v.scale;
+            int c1 = c0 + v.scale < colEnd ? c0 + v.scale : colEnd;
+            *out++ = dominantState(zone + (size_t)(r0 - rowOffset) * pitch + (c0 - colOffset), pitch, r1 - r0, c1 - c0);
+        }
+    }
+}
+
+#endif
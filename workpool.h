@@ -0,0 +1,206 @@
+// Pool di thread persistente con work stealing, usato per dividere la funzione di transizione
+// di un processo MPI tra più core.
+//
+// Un lavoro è un insieme di tile numerati da 0 a tiles-1. All'avvio ogni thread riceve un
+// intervallo contiguo di tile (sempre lo stesso a parità di tiles, il che rende efficace il
+// first touch delle matrici); ognuno prende i tile dall'inizio del proprio intervallo e, quando
+// lo ha esaurito, ne ruba dalla fine degli intervalli degli altri thread. Ogni intervallo è
+// una sola parola atomica (inizio << 32 | fine), quindi prelievo e furto sono un compare-and-swap.
+//
+// Il thread 0 è il chiamante di run() (il thread principale del processo, l'unico che chiama MPI
+// con MPI_THREAD_FUNNELED): partecipa al lavoro e tra un tile e l'altro chiama poll().
+
+#ifndef PARASITES_WORKPOOL_H
+#define PARASITES_WORKPOOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <immintrin.h>
+
+// Iterazioni di attesa attiva prima di cedere il core e poi di addormentarsi
+#define POOL_SPIN 2000
+#define POOL_YIELD 200
+
+class WorkPool {
+public:
+    // Con pin, il thread t viene legato alla t-esima CPU (ciclicamente) tra quelle
+    // concesse al processo, ad esempio da mpirun --bind-to
+    WorkPool(int threads, bool pin) : nthreads(threads), queues(threads), stealCount(0),
+                                      epoch(0), done(0), sleepers(0), stop(false)
+    {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if(pin && sched_getaffinity(0, sizeof(mask), &mask) == 0)
+            for(int c = 0; c < CPU_SETSIZE; ++c)
+                if(CPU_ISSET(c, &mask))
+                    cpus.push_back(c);
+
+        pinTo(0);
+        for(int t = 1; t < nthreads; ++t)
+            workers.emplace_back(&WorkPool::worker, this, t);
+    }
+
+    ~WorkPool()
+    {
+        stop = true;
+        wake();
+        for(size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    int size() const { return nthreads; }
+    long steals() const { return stealCount.load(); }
+
+    // Esegue body(tile, thread) per ogni tile; ritorna quando tutti i tile sono stati eseguiti
+    template<class Body, class Poll>
+    void run(int tiles, Body &body, Poll &poll)
+    {
+        job = &call<Body>;
+        jobBody = &body;
+        pollFn = &call0<Poll>;
+        pollBody = &poll;
+
+        for(int t = 0; t < nthreads; ++t) {
+            uint64_t b = (uint64_t)tiles * t / nthreads, e = (uint64_t)tiles * (t+1) / nthreads;
+            queues[t].range.store(b << 32 | e, std::memory_order_relaxed);
+        }
+        done.store(0);
+        epoch.fetch_add(1);
+        if(sleepers.load() > 0)
+            wake();
+
+        execute(0);
+
+        for(int i = 0; done.load(std::memory_order_acquire) != nthreads-1; ++i) {
+            poll();
+            if(i > POOL_SPIN)
+                std::this_thread::yield();
+            else _mm_pause();
+        }
+    }
+
+    template<class Body>
+    void run(int tiles, Body &body)
+    {
+        struct { void operator()() {} } nothing;
+        run(tiles, body, nothing);
+    }
+
+private:
+    struct alignas(64) Queue {
+        std::atomic<uint64_t> range;
+    };
+
+    int nthreads;
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::vector<int> cpus;
+    std::atomic<long> stealCount;
+
+    // Lavoro corrente: funzioni di trampolino verso i lambda del chiamante
+    void (*job)(void *body, int tile, int thread);
+    void *jobBody;
+    void (*pollFn)(void *body);
+    void *pollBody;
+
+    std::atomic<long> epoch;
+    std::atomic<int> done, sleepers;
+    std::atomic<bool> stop;
+    std::mutex lock;
+    std::condition_variable wakeup;
+
+    template<class Body>
+    static void call(void *body, int tile, int thread) { (*(Body*)body)(tile, thread); }
+
+    template<class Poll>
+    static void call0(void *body) { (*(Poll*)body)(); }
+
+    void pinTo(int t)
+    {
+        if(cpus.empty())
+            return;
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpus[t % cpus.size()], &mask);
+        pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+    }
+
+    void wake()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        wakeup.notify_all();
+    }
+
+    // Prelievo dall'inizio del proprio intervallo
+    int pop(int t)
+    {
+        uint64_t v = queues[t].range.load(std::memory_order_relaxed);
+        while((uint32_t)(v >> 32) < (uint32_t)v)
+            if(queues[t].range.compare_exchange_weak(v, v + ((uint64_t)1 << 32)))
+                return (int)(v >> 32);
+        return -1;
+    }
+
+    // Furto dalla fine dell'intervallo di un altro thread
+    int steal(int victim)
+    {
+        uint64_t v = queues[victim].range.load(std::memory_order_relaxed);
+        while((uint32_t)(v >> 32) < (uint32_t)v)
+            if(queues[victim].range.compare_exchange_weak(v, v - 1))
+                return (int)(uint32_t)(v - 1);
+        return -1;
+    }
+
+    void execute(int t)
+    {
+        while(true) {
+            int tile = pop(t);
+
+            for(int i = 1; tile < 0 && i < nthreads; ++i)
+                if((tile = steal((t + i) % nthreads)) >= 0)
+                    stealCount.fetch_add(1, std::memory_order_relaxed);
+
+            if(tile < 0)
+                return;
+
+            job(jobBody, tile, t);
+            if(t == 0)
+                pollFn(pollBody);
+        }
+    }
+
+    void worker(int t)
+    {
+        long seen = 0;
+        pinTo(t);
+
+        while(true) {
+            for(int i = 0; epoch.load() == seen && !stop; ++i) {
+                if(i < POOL_SPIN)
+                    _mm_pause();
+                else if(i < POOL_SPIN + POOL_YIELD)
+                    std::this_thread::yield();
+                else {
+                    std::unique_lock<std::mutex> guard(lock);
+                    sleepers.fetch_add(1);
+                    wakeup.wait(guard, [&]{ return epoch.load() != seen || stop; });
+                    sleepers.fetch_sub(1);
+                }
+            }
+            if(stop)
+                return;
+
+            seen = epoch.load();
+            execute(t);
+            done.fetch_add(1, std::memory_order_release);
+        }
+    }
+};
+
+#endif